@@ -7,6 +7,8 @@
 #define AUDIO_SAMPLE_FREQ 44100
 
 #include "audio/audio.hpp"
+#include "engine/engine.hpp"
+#include "engine/frame_stats.hpp"
 
 #define audio_pio __CONCAT(pio, PICO_AUDIO_I2S_PIO)
 
@@ -73,12 +75,16 @@ void update_audio(uint32_t time) {
       max_samples = AUDIO_MAX_SAMPLE_UPDATE;
 #endif
 
+    auto mix_start_us = blit::now_us();
+
     for(uint32_t i = 0; i < max_samples; i += 2) {
       int val = (int)blit::get_audio_frame() - 0x8000;
       *samples++ = val;
       *samples++ = val;
     }
 
+    blit::frame_stats_audio(blit::us_diff(mix_start_us, blit::now_us()));
+
     cur_buffer->sample_count += max_samples;
 
     if(cur_buffer->sample_count == cur_buffer->max_sample_count) {
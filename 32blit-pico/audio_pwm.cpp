@@ -9,6 +9,8 @@
 #define AUDIO_SAMPLE_FREQ 22050
 
 #include "audio/audio.hpp"
+#include "engine/engine.hpp"
+#include "engine/frame_stats.hpp"
 
 #define audio_pio __CONCAT(pio, PICO_AUDIO_I2S_PIO)
 
@@ -76,11 +78,15 @@ void update_audio(uint32_t time) {
 
     auto max_samples = cur_buffer->max_sample_count - cur_buffer->sample_count;
 
+    auto mix_start_us = blit::now_us();
+
     for(uint32_t i = 0; i < max_samples; i++) {
       int val = (int)blit::get_audio_frame() - 0x8000;
       *samples++ = val;
     }
 
+    blit::frame_stats_audio(blit::us_diff(mix_start_us, blit::now_us()));
+
     cur_buffer->sample_count += max_samples;
 
     if(cur_buffer->sample_count == cur_buffer->max_sample_count) {
@@ -373,7 +373,9 @@ void update_display(uint32_t time) {
   if(!do_render)
     return;
   
+  auto render_start_us = blit::now_us();
   blit::render(time);
+  blit::frame_stats_render(blit::us_diff(render_start_us, blit::now_us()));
 
   flush_batch();
 
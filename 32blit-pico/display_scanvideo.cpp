@@ -53,7 +53,9 @@ void update_display(uint32_t time) {
   if(do_render) {
     if(cur_screen_mode == ScreenMode::lores)
       screen.data = (uint8_t *)screen_fb + (buf_index ^ 1) * lores_page_size; // only works because there's no "firmware" here
+    auto render_start_us = blit::now_us();
     ::render(time);
+    blit::frame_stats_render(blit::us_diff(render_start_us, blit::now_us()));
     do_render = false;
   }
 }
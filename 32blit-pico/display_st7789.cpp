@@ -39,7 +39,9 @@ void update_display(uint32_t time) {
       st7789::frame_buffer = (uint16_t *)screen.data;
     }
 
+    auto render_start_us = blit::now_us();
     ::render(time);
+    blit::frame_stats_render(blit::us_diff(render_start_us, blit::now_us()));
 
     if(!have_vsync) {
       while(st7789::dma_is_busy()) {} // may need to wait for lores.
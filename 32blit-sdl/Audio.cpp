@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <iostream>
 #include "SDL.h"
@@ -6,14 +7,24 @@
 #include "Audio.hpp"
 #include "audio/audio.hpp"
 #include "engine/api_private.hpp"
+#include "engine/profile_zone.hpp"
 
 blit::AudioChannel channels[CHANNEL_COUNT];
 
 static void _audio_callback(void *userdata, uint8_t *stream, int len);
 
-Audio::Audio() {
+// mix timings from the audio thread, added to the frame stats by the system loop
+static const int max_mix_times = 16;
+static uint32_t mix_times[max_mix_times];
+static std::atomic<uint32_t> mix_times_written(0), mix_times_read(0);
+
+Audio::Audio(bool open_device) {
     blit::api.channels = channels;
 
+    // headless, the audio is mixed by the system loop
+    if(!open_device)
+        return;
+
     SDL_AudioSpec desired = {}, audio_spec = {};
 
     desired.freq = _sample_rate;
@@ -32,17 +43,41 @@ Audio::Audio() {
     SDL_PauseAudioDevice(audio_device, 0);
 }
 
+void Audio::update_stats() {
+    auto read = mix_times_read.load(std::memory_order_relaxed);
+    auto written = mix_times_written.load(std::memory_order_acquire);
+
+    for(; read != written; read++)
+        blit::frame_stats_audio(mix_times[read % max_mix_times]);
+
+    mix_times_read.store(read, std::memory_order_release);
+}
+
 Audio::~Audio() {
+    if(!audio_device)
+        return;
+
     SDL_PauseAudioDevice(audio_device, 1);
     SDL_CloseAudioDevice(audio_device);
 }
 
 static void _audio_bufferfill(short *buffer, int buffer_size){
+    blit_profile_zone("audio mix");
+
     memset(buffer, 0, buffer_size);
 
+    auto start_us = blit::now_us();
+
     for(auto sample = 0; sample < buffer_size; sample++){
         buffer[sample] = (int)blit::get_audio_frame() - 0x8000;
     }
+
+    // dropped if the system loop is stalled
+    auto written = mix_times_written.load(std::memory_order_relaxed);
+    if(written - mix_times_read.load(std::memory_order_acquire) < max_mix_times) {
+        mix_times[written % max_mix_times] = blit::us_diff(start_us, blit::now_us());
+        mix_times_written.store(written + 1, std::memory_order_release);
+    }
 }
 
 static void _audio_callback(void *userdata, uint8_t *stream, int len){
@@ -1,10 +1,12 @@
 class Audio {
 	public:
-		Audio();
+		Audio(bool open_device = true);
 		~Audio();
 
+		void update_stats();
+
 	private:
         const unsigned int _sample_rate = 22050;
 
-        SDL_AudioDeviceID audio_device;
+        SDL_AudioDeviceID audio_device = 0;
 };
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <iostream>
+
+#include "SDL.h"
+#include "SDL_image.h"
+
+#include "FrameDump.hpp"
+#include "System.hpp"
+
+static int frame_dump_write_thread(void *ptr) {
+	// Bounce back in to the class.
+	FrameDump *dump = (FrameDump *)ptr;
+	return dump->write_thread();
+}
+
+// FNV-1a over 64-bit words, with a final mix so that small changes affect every bit
+uint64_t hash_frame(const uint8_t *data, size_t len, uint64_t hash) {
+	const uint64_t prime = 0x100000001b3;
+
+	for(; len >= 8; data += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		hash = (hash ^ word) * prime;
+	}
+
+	for(; len; data++, len--)
+		hash = (hash ^ *data) * prime;
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccd;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+FrameDump::FrameDump(const char *image_path, int image_interval, const char *hash_path)
+: image_path(image_path ? image_path : ""), image_interval(image_path ? std::max(image_interval, 1) : 0) {
+	if(hash_path) {
+		hash_file = fopen(hash_path, "w");
+		if(!hash_file) {
+			std::cerr << "Could not open " << hash_path << std::endl;
+			ok_ = false;
+			return;
+		}
+	}
+
+	for(auto &frame : queue)
+		frame.data.resize(System::max_width * System::max_height * 3);
+
+	rgb.resize(System::max_width * System::max_height * 3);
+
+	m_queue = SDL_CreateMutex();
+	c_queue = SDL_CreateCond();
+	t_write = SDL_CreateThread(frame_dump_write_thread, "FrameDump", (void *)this);
+}
+
+FrameDump::~FrameDump() {
+	finish();
+
+	if(hash_file)
+		fclose(hash_file);
+
+	SDL_DestroyCond(c_queue);
+	SDL_DestroyMutex(m_queue);
+}
+
+void FrameDump::add(int index, const uint8_t *data, blit::PixelFormat format, const blit::Pen *palette, int width, int height) {
+	if(!t_write)
+		return;
+
+	bool write_image = image_interval && index % image_interval == 0;
+	if(!write_image && !hash_file)
+		return;
+
+	// wait for space, every frame is needed for the hashes to be comparable
+	SDL_LockMutex(m_queue);
+	while(queue_count == queue_size)
+		SDL_CondWait(c_queue, m_queue);
+	int slot = (queue_read + queue_count) % queue_size;
+	SDL_UnlockMutex(m_queue);
+
+	auto &frame = queue[slot];
+	frame.index = index;
+	frame.format = format;
+	frame.width = width;
+	frame.height = height;
+	memcpy(frame.data.data(), data, width * height * blit::pixel_format_stride[int(format)]);
+
+	if(format == blit::PixelFormat::P)
+		memcpy(frame.palette, palette, sizeof(frame.palette));
+
+	SDL_LockMutex(m_queue);
+	queue_count++;
+	SDL_CondBroadcast(c_queue);
+	SDL_UnlockMutex(m_queue);
+}
+
+// write out anything still queued and stop the thread
+void FrameDump::finish() {
+	if(!t_write)
+		return;
+
+	SDL_LockMutex(m_queue);
+	finishing = true;
+	SDL_CondBroadcast(c_queue);
+	SDL_UnlockMutex(m_queue);
+
+	SDL_WaitThread(t_write, nullptr);
+	t_write = nullptr;
+}
+
+int FrameDump::write_thread() {
+	while(true) {
+		SDL_LockMutex(m_queue);
+		while(queue_count == 0 && !finishing)
+			SDL_CondWait(c_queue, m_queue);
+
+		if(queue_count == 0) {
+			SDL_UnlockMutex(m_queue);
+			break;
+		}
+
+		auto &frame = queue[queue_read];
+		SDL_UnlockMutex(m_queue);
+
+		write_frame(frame);
+
+		SDL_LockMutex(m_queue);
+		queue_read = (queue_read + 1) % queue_size;
+		queue_count--;
+		SDL_CondBroadcast(c_queue);
+		SDL_UnlockMutex(m_queue);
+	}
+
+	return 0;
+}
+
+void FrameDump::write_frame(Frame &frame) {
+	auto size = frame.width * frame.height * blit::pixel_format_stride[int(frame.format)];
+
+	if(hash_file) {
+		// include the palette so that palette changes are detected
+		auto hash = hash_frame(frame.data.data(), size);
+		if(frame.format == blit::PixelFormat::P)
+			hash = hash_frame((const uint8_t *)frame.palette, sizeof(frame.palette), hash);
+
+		fprintf(hash_file, "%i %016" PRIx64 "\n", frame.index, hash);
+	}
+
+	if(image_interval && frame.index % image_interval == 0) {
+		convert_to_rgb(frame.data.data(), frame.format, frame.palette, frame.width, frame.height, 1, rgb.data());
+
+		char filename[32];
+		snprintf(filename, sizeof(filename), "/frame%05i.png", frame.index);
+
+#ifndef __EMSCRIPTEN__
+		auto surface = SDL_CreateRGBSurfaceWithFormatFrom(rgb.data(), frame.width, frame.height, 24, frame.width * 3, SDL_PIXELFORMAT_RGB24);
+		if(IMG_SavePNG(surface, (image_path + filename).c_str()) != 0)
+			std::cerr << "Could not write " << image_path << filename << ": " << IMG_GetError() << std::endl;
+		SDL_FreeSurface(surface);
+#endif
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "graphics/surface.hpp"
+
+// Writes every Nth frame as a PNG and/or a hash of every frame, on a separate thread so the game isn't slowed down
+class FrameDump {
+	public:
+		FrameDump(const char *image_path, int image_interval, const char *hash_path);
+		~FrameDump();
+
+		bool ok() const {return ok_;}
+
+		void add(int frame, const uint8_t *data, blit::PixelFormat format, const blit::Pen *palette, int width, int height);
+		void finish();
+
+		int write_thread();
+
+	private:
+		struct Frame {
+			int index;
+			blit::PixelFormat format;
+			int width, height;
+			blit::Pen palette[256];
+			std::vector<uint8_t> data;
+		};
+
+		void write_frame(Frame &frame);
+
+		static const int queue_size = 4;
+
+		std::string image_path;
+		int image_interval;
+		FILE *hash_file = nullptr;
+		bool ok_ = true;
+
+		Frame queue[queue_size];
+		int queue_read = 0, queue_count = 0;
+		bool finishing = false;
+
+		SDL_mutex *m_queue = nullptr;
+		SDL_cond *c_queue = nullptr;
+		SDL_Thread *t_write = nullptr;
+
+		std::vector<uint8_t> rgb;
+};
+
+uint64_t hash_frame(const uint8_t *data, size_t len, uint64_t hash = 0xcbf29ce484222325);
@@ -105,12 +105,13 @@ void handle_event(SDL_Event &event) {
 
 		default:
 			if(event.type == System::loop_event) {
-				blit_renderer->update(blit_system);
-				blit_system->notify_redraw();
-				blit_renderer->present();
+				if(blit_system->take_frame()) {
+					blit_renderer->update(blit_system);
+					blit_renderer->present();
 #ifdef VIDEO_CAPTURE
-				if (blit_capture->recording()) blit_capture->capture(blit_renderer);
+					if (blit_capture->recording()) blit_capture->capture(blit_system);
 #endif
+				}
 			} else if (event.type == System::timer_event) {
 				switch(event.user.code) {
 					case 0:
@@ -137,20 +138,30 @@ void em_loop() {
 
 	blit_multiplayer->update();
 	blit_system->loop();
-	blit_renderer->update(blit_system);
-	blit_renderer->present();
+	if(blit_system->take_frame()) {
+		blit_renderer->update(blit_system);
+		blit_renderer->present();
+	}
 }
 #endif
 
 int main(int argc, char *argv[]) {
   int x = SDL_WINDOWPOS_UNDEFINED, y = SDL_WINDOWPOS_UNDEFINED;
   bool fullscreen = false;
+  bool vsync = false;
+
+  bool headless = false;
+  int headless_frames = -1;
+  const char *stats_path = nullptr, *dump_path = nullptr, *hash_path = nullptr;
+  int dump_interval = 1;
+  const char *record_path = nullptr, *replay_path = nullptr;
 
   std::cout << metadata_title << " " << metadata_version << std::endl;
   std::cout << "Powered by 32Blit SDL2 runtime - github.com/32blit/32blit-sdk" << std::endl << std::endl;
 
 	auto mp_mode = Multiplayer::Mode::Auto;
 	std::string mp_address = "localhost";
+	auto mp_transport = Multiplayer::Transport::TCP;
 
 	for(int i = 1; i < argc; i++) {
 		std::string arg_str(argv[i]);
@@ -164,6 +175,8 @@ int main(int argc, char *argv[]) {
 		}
 		else if(arg_str == "--listen")
 			mp_mode = Multiplayer::Mode::Listen;
+		else if(arg_str == "--udp")
+			mp_transport = Multiplayer::Transport::UDP;
 		else if(arg_str == "--position") {
 			SDL_sscanf(argv[i+1], "%d,%d", &x, &y);
 		}	else if(arg_str == "--size" && i + 1 < argc) {
@@ -177,6 +190,33 @@ int main(int argc, char *argv[]) {
       i++;
 		} else if(arg_str == "--fullscreen")
 			fullscreen = true;
+		else if(arg_str == "--headless")
+			headless = true;
+		else if(arg_str == "--frames" && i + 1 < argc)
+			headless_frames = SDL_atoi(argv[++i]);
+		else if(arg_str == "--stats" && i + 1 < argc)
+			stats_path = argv[++i];
+		else if(arg_str == "--dump-frames" && i + 1 < argc)
+			dump_path = argv[++i];
+		else if(arg_str == "--dump-interval" && i + 1 < argc)
+			dump_interval = SDL_atoi(argv[++i]);
+		else if(arg_str == "--hash-log" && i + 1 < argc)
+			hash_path = argv[++i];
+		else if(arg_str == "--record" && i + 1 < argc)
+			record_path = argv[++i];
+		else if(arg_str == "--replay" && i + 1 < argc) {
+			replay_path = argv[++i];
+			headless = true;
+		}
+		else if(arg_str == "--render-rate" && i + 1 < argc) {
+			std::string rate_str(argv[++i]);
+			if(rate_str == "vsync")
+				vsync = true;
+			else if(SDL_atoi(rate_str.c_str()) > 0)
+				System::render_rate = SDL_atoi(rate_str.c_str());
+		}
+		else if(arg_str == "--precise-timing")
+			System::precise_timing = true;
     else if(arg_str == "--credits") {
 			std::cout << "32Blit was made possible by:" << std::endl;
 			std::cout << std::endl;
@@ -209,9 +249,20 @@ int main(int argc, char *argv[]) {
 			std::cout << "Usage: " << argv[0] << " <options>" << std::endl << std::endl;
 			std::cout << " --connect <addr>     -- Connect to a listening game instance." << std::endl;
 			std::cout << " --listen             -- Listen for incoming connections." << std::endl;
+			std::cout << " --udp                -- Use UDP for multiplayer, late messages are dropped." << std::endl;
 			std::cout << " --position x,y       -- Set window position." << std::endl;
       std::cout << " --size w,h           -- Set display size. (max 320x240)" << std::endl;
+			std::cout << " --render-rate <hz>   -- Set render rate, or \"vsync\" to match the display. (default 50)" << std::endl;
+			std::cout << " --precise-timing     -- Spin for steadier frame timing, uses about 20% of a core. (on with vsync)" << std::endl;
 			std::cout << " --launch_path <file> -- Emulates the file associations on the console." << std::endl;
+			std::cout << " --headless           -- Run without a window or audio, as fast as possible." << std::endl;
+			std::cout << " --frames <n>         -- Number of frames to run when headless. (default 1000, or all of a replay)" << std::endl;
+			std::cout << " --stats <file>       -- Write per-frame timings as CSV when headless." << std::endl;
+			std::cout << " --dump-frames <dir>  -- Write frames to <dir> as PNGs when headless." << std::endl;
+			std::cout << " --dump-interval <n>  -- Only write every nth frame. (default 1)" << std::endl;
+			std::cout << " --hash-log <file>    -- Write a hash of each frame when headless." << std::endl;
+			std::cout << " --record <file>      -- Record the input and timing of this session, not headless." << std::endl;
+			std::cout << " --replay <file>      -- Replay a recorded session headless." << std::endl;
 			std::cout << " --credits            -- Print contributor credits and exit." << std::endl;
 			std::cout << " --info               -- Print metadata info and exit." << std::endl << std::endl;
 			SDL_DestroyWindow(window);
@@ -220,6 +271,42 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	if(headless && record_path) {
+		// there's no live input to record
+		std::cerr << "--record can't be used with --headless or --replay" << std::endl;
+		SDL_Quit();
+		return 1;
+	}
+
+	if(headless) {
+		// no window, renderer, audio device or timer, frames run back-to-back on a virtual clock
+		if (SDL_Init(0) < 0) {
+			std::cerr << "could not initialize SDL2: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+
+		blit_system = new System();
+		blit_input = new Input(blit_system);
+		blit_multiplayer = new Multiplayer(mp_mode, mp_address, mp_transport);
+		blit_audio = new Audio(false);
+
+		if(replay_path && !blit_system->load_replay(replay_path))
+			return 1;
+
+		if(headless_frames < 0 && !replay_path)
+			headless_frames = 1000;
+
+		int ret = blit_system->run_headless(headless_frames, stats_path, dump_path, dump_interval, hash_path);
+
+		delete blit_system;
+		delete blit_input;
+		delete blit_multiplayer;
+		delete blit_audio;
+
+		SDL_Quit();
+		return ret;
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_GAMECONTROLLER|SDL_INIT_AUDIO) < 0) {
 		std::cerr << "could not initialize SDL2: " << SDL_GetError() << std::endl;
 		return 1;
@@ -238,16 +325,30 @@ int main(int argc, char *argv[]) {
 	}
 	SDL_SetWindowMinimumSize(window, System::width, System::height);
 
+	if(vsync) {
+		// frames have to be ready for each refresh
+		System::precise_timing = true;
+
+		SDL_DisplayMode display_mode;
+		if(SDL_GetWindowDisplayMode(window, &display_mode) == 0 && display_mode.refresh_rate > 0)
+			System::render_rate = display_mode.refresh_rate;
+		else
+			System::render_rate = 60;
+	}
+
   blit_system = new System();
   blit_input = new Input(blit_system);
-	blit_multiplayer = new Multiplayer(mp_mode, mp_address);
-	blit_renderer = new Renderer(window, System::width, System::height);
+	blit_multiplayer = new Multiplayer(mp_mode, mp_address, mp_transport);
+	blit_renderer = new Renderer(window, System::width, System::height, vsync);
 	blit_audio = new Audio();
 
 #ifdef VIDEO_CAPTURE
 	blit_capture = new VideoCapture(argv[0]);
 #endif
 
+	if(record_path)
+		blit_system->start_recording(record_path);
+
 	blit_system->run();
 
 #ifdef __EMSCRIPTEN__
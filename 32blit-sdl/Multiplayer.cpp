@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iostream>
 
 #include "Multiplayer.hpp"
@@ -6,12 +7,64 @@
 
 using namespace blit;
 
-Multiplayer::Multiplayer(Mode mode, const std::string &address) : mode(mode), address(address) {
+enum UDPPacketType {
+    UDP_HELLO = 1,   // connect -> listen, until answered
+    UDP_WELCOME = 2, // listen -> connect
+    UDP_DATA = 3,    // batch of messages, each prefixed with a 16-bit length
+    UDP_PING = 4,    // 32-bit timestamp
+    UDP_PONG = 5,    // the timestamp from the ping
+    UDP_BYE = 6
+};
+
+static const uint16_t port = 0x32B1;
+
+static void write32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t read32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+Multiplayer::Multiplayer(Mode mode, const std::string &address, Transport transport) : mode(mode), address(address), transport(transport) {
     // shouldn't fail unless we ran out of memory
     sock_set = SDLNet_AllocSocketSet(2);
+
+    recv_buf = new uint8_t[max_message_size];
+
+    if(transport == Transport::UDP) {
+        udp_send_packet = SDLNet_AllocPacket(max_udp_packet_size);
+        udp_recv_packet = SDLNet_AllocPacket(max_udp_packet_size);
+        udp_control_packet = SDLNet_AllocPacket(udp_header_size + 4);
+        udp_send_packet->len = udp_header_size;
+    }
 }
 
 Multiplayer::~Multiplayer() {
+    if(enabled && stats.messages_sent + stats.messages_received)
+        print_stats();
+
+    if(udp_socket) {
+        if(has_peer)
+            send_udp_packet(UDP_BYE, nullptr, 0);
+
+        SDLNet_UDP_Close(udp_socket);
+    }
+
+    if(udp_send_packet)
+        SDLNet_FreePacket(udp_send_packet);
+
+    if(udp_recv_packet)
+        SDLNet_FreePacket(udp_recv_packet);
+
+    if(udp_control_packet)
+        SDLNet_FreePacket(udp_control_packet);
+
+    delete[] recv_buf;
+
     if(sock_set)
         SDLNet_FreeSocketSet(sock_set);
 
@@ -25,7 +78,14 @@ Multiplayer::~Multiplayer() {
 void Multiplayer::update() {
     if(!enabled)
         return;
-  
+
+    if(transport == Transport::UDP) {
+        update_udp();
+        return;
+    }
+
+    flush();
+
     if(!socket && !listen_socket) {
         // attempt to reconnect
         auto now = SDL_GetTicks();
@@ -65,7 +125,7 @@ void Multiplayer::update() {
       if(!socket || !SDLNet_SocketReady(socket))
           return;
 
-      if(!recv_buf) {
+      if(!receiving) {
           // read header and setup
 
           auto read = SDLNet_TCP_Recv(socket, head_buf + head_off, 8 - head_off);
@@ -96,8 +156,8 @@ void Multiplayer::update() {
             } while(off != 2);
 
             recv_len = head_buf[0] | (head_buf[1] << 8);
-            recv_buf = new uint8_t[recv_len];
             recv_off = 0;
+            receiving = true;
             head_off = 0;
 
           } else if(memcmp(head_buf, "32BLMLTI", 8) == 0) {
@@ -114,15 +174,14 @@ void Multiplayer::update() {
             head_off = 0;
           }
 
-          if(!recv_buf || SDLNet_CheckSockets(sock_set, 0) <= 0)
+          if(!receiving || SDLNet_CheckSockets(sock_set, 0) <= 0)
               return;
       }
 
       auto read = SDLNet_TCP_Recv(socket, recv_buf + recv_off, recv_len - recv_off);
       if(read <= 0) {
           // failed/disconnected
-          delete[] recv_buf;
-          recv_buf = nullptr;
+          receiving = false;
           disconnect();
           return;
       }
@@ -131,20 +190,34 @@ void Multiplayer::update() {
 
       // got message, pass to user
       if(recv_off == recv_len) {
+          stats.messages_received++;
+
           if(api.message_received)
               api.message_received(recv_buf, recv_len);
 
-          delete[] recv_buf;
-          recv_buf = nullptr;
+          receiving = false;
       }
     }
 }
 
 bool Multiplayer::is_connected() const {
+    if(transport == Transport::UDP)
+        return has_peer && handshake;
+
     return socket != nullptr && handshake;
 }
 
 void Multiplayer::set_enabled(bool enabled) {
+    if(transport == Transport::UDP) {
+        if(enabled && !udp_socket)
+            setup_udp();
+        else if(!enabled)
+            disconnect_udp();
+
+        this->enabled = enabled;
+        return;
+    }
+
     if(enabled) {
         setup();
     } else {
@@ -160,6 +233,30 @@ void Multiplayer::set_enabled(bool enabled) {
 }
 
 void Multiplayer::send_message(const uint8_t *data, uint16_t length) {
+    if(transport == Transport::UDP) {
+        if(!is_connected())
+            return;
+
+        if(udp_header_size + 2 + length > max_udp_packet_size) {
+            std::cerr << "Message too large for UDP (" << length << " bytes)" << std::endl;
+            return;
+        }
+
+        // start a new batch if this one would get too big, a large message gets a packet to itself
+        int batch_len = udp_send_packet->len - udp_header_size;
+        if(batch_len && batch_len + 2 + length > udp_batch_size)
+            flush();
+
+        auto out = udp_send_packet->data + udp_send_packet->len;
+        out[0] = length;
+        out[1] = length >> 8;
+        memcpy(out + 2, data, length);
+
+        udp_send_packet->len += 2 + length;
+        stats.messages_sent++;
+        return;
+    }
+
     if(!socket)
         return;
 
@@ -170,22 +267,16 @@ void Multiplayer::send_message(const uint8_t *data, uint16_t length) {
         static_cast<uint8_t>(length >> 8)
     };
 
-    if(SDLNet_TCP_Send(socket, head, 10) != 10) {
-        // failed
-        disconnect();
-        return;
-    }
+    send_buf.insert(send_buf.end(), head, head + 10);
+    send_buf.insert(send_buf.end(), data, data + length);
+    stats.messages_sent++;
+}
 
-    auto sent = SDLNet_TCP_Send(socket, data, length);
-    if(sent < length) {
-        // failed
-        disconnect();
-    }
+const Multiplayer::Stats &Multiplayer::get_stats() const {
+    return stats;
 }
 
 void Multiplayer::setup() {
-    const uint16_t port = 0x32B1;
-
     IPaddress ip;
 
     // try connecting first for auto
@@ -228,6 +319,7 @@ void Multiplayer::disconnect() {
     SDLNet_TCP_Close(socket);
     socket = nullptr;
 
+    send_buf.clear();
     handshake = false;
 }
 
@@ -237,3 +329,273 @@ void Multiplayer::stop_listening() {
     SDLNet_TCP_Close(listen_socket);
     listen_socket = nullptr;
 }
+
+// send everything queued during the last tick
+void Multiplayer::flush() {
+    if(transport == Transport::UDP) {
+        if(udp_send_packet->len == udp_header_size)
+            return;
+
+        send_udp_packet(UDP_DATA, nullptr, udp_send_packet->len - udp_header_size);
+        udp_send_packet->len = udp_header_size;
+        return;
+    }
+
+    if(send_buf.empty() || !socket)
+        return;
+
+    // one send for the whole batch, the buffer keeps its capacity for the next tick
+    int length = send_buf.size();
+    auto sent = SDLNet_TCP_Send(socket, send_buf.data(), length);
+    send_buf.clear();
+
+    if(sent < length) {
+        // failed
+        disconnect();
+    }
+}
+
+void Multiplayer::update_udp() {
+    auto now = SDL_GetTicks();
+
+    if(!udp_socket) {
+        // attempt to reopen
+        if((now - last_connect_time) > retry_interval) {
+            setup_udp();
+
+            last_connect_time = now;
+        }
+        return;
+    }
+
+    flush();
+
+    int ret;
+    while((ret = SDLNet_UDP_Recv(udp_socket, udp_recv_packet)) == 1)
+        handle_udp_packet();
+
+    if(ret == -1)
+        std::cerr << "Failed to receive packet: " << SDLNet_GetError() << std::endl;
+
+    now = SDL_GetTicks();
+
+    if(!handshake) {
+        if(mode == Mode::Connect && (now - last_hello_time) >= hello_interval) {
+            send_udp_packet(UDP_HELLO, nullptr, 0);
+            last_hello_time = now;
+        }
+        return;
+    }
+
+    if((now - last_recv_time) > udp_timeout) {
+        std::cout << "Connection timed out" << std::endl;
+        print_stats();
+
+        handshake = false;
+        if(mode == Mode::Listen)
+            has_peer = false;
+
+        return;
+    }
+
+    if((now - last_ping_time) >= ping_interval) {
+        uint8_t stamp[4];
+        write32(stamp, now_us());
+        send_udp_packet(UDP_PING, stamp, 4);
+
+        last_ping_time = now;
+    }
+}
+
+void Multiplayer::setup_udp() {
+    // auto listens if the port is free, otherwise there's probably another instance on this machine to connect to
+    if(mode != Mode::Connect)
+        udp_socket = SDLNet_UDP_Open(port);
+
+    if(udp_socket)
+        mode = Mode::Listen;
+    else if(mode != Mode::Listen) {
+        if(SDLNet_ResolveHost(&peer, address.c_str(), port) == -1) {
+            std::cerr << "Failed to resolve \"" << address << "\"!" << std::endl;
+            return;
+        }
+
+        udp_socket = SDLNet_UDP_Open(0);
+
+        if(udp_socket) {
+            mode = Mode::Connect;
+            has_peer = true;
+            last_hello_time = SDL_GetTicks() - hello_interval;
+        }
+    }
+
+    if(!udp_socket)
+        std::cerr << "Failed to open socket: " << SDLNet_GetError() << std::endl;
+}
+
+void Multiplayer::disconnect_udp() {
+    if(!udp_socket)
+        return;
+
+    if(has_peer)
+        send_udp_packet(UDP_BYE, nullptr, 0);
+
+    SDLNet_UDP_Close(udp_socket);
+    udp_socket = nullptr;
+
+    udp_send_packet->len = udp_header_size;
+    has_peer = false;
+    handshake = false;
+}
+
+void Multiplayer::handle_udp_packet() {
+    auto packet = udp_recv_packet;
+    auto data = packet->data;
+
+    if(packet->len < udp_header_size || memcmp(data, "32BU", 4) != 0)
+        return;
+
+    auto type = data[4];
+    auto sequence = read32(data + 5);
+
+    bool from_peer = has_peer && packet->address.host == peer.host && packet->address.port == peer.port;
+
+    // a delayed hello from the current peer
+    if(type == UDP_HELLO && from_peer && handshake && int32_t(sequence - recv_sequence) <= 0)
+        return;
+
+    if(type == UDP_HELLO && mode == Mode::Listen) {
+        // (re)connected, answer even if we already have this peer as the welcome may have been lost
+        if(!from_peer) {
+            auto ip = SDL_SwapBE32(packet->address.host);
+            std::cout << (ip >> 24) << "." << ((ip >> 16) & 0xFF) << "." << ((ip >> 8) & 0xFF) << "." << (ip & 0xFF) << " connected" << std::endl;
+        }
+
+        peer = packet->address;
+        has_peer = handshake = true;
+        recv_sequence = sequence;
+        last_recv_time = SDL_GetTicks();
+
+        send_udp_packet(UDP_WELCOME, nullptr, 0);
+        return;
+    }
+
+    // ignore anyone else
+    if(!from_peer)
+        return;
+
+    stats.packets_received++;
+    last_recv_time = SDL_GetTicks();
+
+    if(type == UDP_WELCOME && mode == Mode::Connect) {
+        if(!handshake) {
+            std::cout << "Connected" << std::endl;
+
+            handshake = true;
+            recv_sequence = sequence;
+        } else if(int32_t(sequence - recv_sequence) > 0)
+            recv_sequence = sequence; // a repeated welcome, don't go back to packets already delivered
+
+        return;
+    }
+
+    if(!handshake)
+        return;
+
+    // drop anything older than what we've already seen
+    auto diff = int32_t(sequence - recv_sequence);
+    if(diff <= 0) {
+        stats.packets_late++;
+        return;
+    }
+
+    stats.packets_lost += diff - 1;
+    recv_sequence = sequence;
+
+    auto payload = data + udp_header_size;
+    int payload_len = packet->len - udp_header_size;
+
+    switch(type) {
+        case UDP_DATA:
+            while(payload_len >= 2) {
+                uint16_t length = payload[0] | payload[1] << 8;
+                if(length > payload_len - 2)
+                    break;
+
+                stats.messages_received++;
+
+                if(api.message_received)
+                    api.message_received(payload + 2, length);
+
+                payload += 2 + length;
+                payload_len -= 2 + length;
+            }
+            break;
+
+        case UDP_PING:
+            if(payload_len == 4)
+                send_udp_packet(UDP_PONG, payload, 4);
+            break;
+
+        case UDP_PONG:
+            if(payload_len == 4) {
+                auto rtt = us_diff(read32(payload), now_us());
+
+                stats.rtt_last_us = rtt;
+                if(!stats.rtt_samples || rtt < stats.rtt_min_us)
+                    stats.rtt_min_us = rtt;
+                if(rtt > stats.rtt_max_us)
+                    stats.rtt_max_us = rtt;
+
+                // smoothed like TCP's SRTT
+                stats.rtt_avg_us = stats.rtt_samples ? (stats.rtt_avg_us * 7 + rtt) / 8 : rtt;
+                stats.rtt_samples++;
+            }
+            break;
+
+        case UDP_BYE:
+            std::cout << "Disconnected" << std::endl;
+            print_stats();
+
+            handshake = false;
+            if(mode == Mode::Listen)
+                has_peer = false;
+            break;
+    }
+}
+
+void Multiplayer::send_udp_packet(uint8_t type, const uint8_t *payload, int length) {
+    if(!udp_socket || !has_peer)
+        return;
+
+    // batches are built in place, everything else is small and sent from its own packet
+    auto packet = type == UDP_DATA ? udp_send_packet : udp_control_packet;
+    auto data = packet->data;
+
+    memcpy(data, "32BU", 4);
+    data[4] = type;
+    write32(data + 5, ++send_sequence);
+
+    if(packet != udp_send_packet && length)
+        memcpy(data + udp_header_size, payload, length);
+
+    packet->len = udp_header_size + length;
+    packet->address = peer;
+
+    if(SDLNet_UDP_Send(udp_socket, -1, packet) == 0)
+        std::cerr << "Failed to send packet: " << SDLNet_GetError() << std::endl;
+    else
+        stats.packets_sent++;
+}
+
+void Multiplayer::print_stats() {
+    std::cout << "Sent " << stats.messages_sent << " messages, received " << stats.messages_received << std::endl;
+
+    if(transport == Transport::UDP) {
+        std::cout << "Sent " << stats.packets_sent << " packets, received " << stats.packets_received
+                  << " (" << stats.packets_lost << " lost, " << stats.packets_late << " late)" << std::endl;
+
+        if(stats.rtt_samples)
+            std::cout << "RTT " << stats.rtt_avg_us << "us (min " << stats.rtt_min_us << "us, max " << stats.rtt_max_us << "us)" << std::endl;
+    }
+}
@@ -1,9 +1,16 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "SDL_net.h"
 
+// Messages sent during a tick are batched and sent together in update(), which runs after each tick.
+//
+// The default TCP transport uses the same stream protocol as the device. The UDP transport avoids head-of-line
+// blocking for games that send their state every tick: each packet carries a sequence number and packets that arrive
+// late are dropped instead of delivered out of order. Nothing is retransmitted, so a message may be lost. The peers
+// also ping each other to measure the round trip time.
 class Multiplayer final {
     public:
         enum class Mode {
@@ -12,7 +19,23 @@ class Multiplayer final {
             Connect
         };
 
-        Multiplayer(Mode mode, const std::string &address);
+        enum class Transport {
+            TCP,
+            UDP
+        };
+
+        struct Stats {
+            uint32_t messages_sent = 0, messages_received = 0;
+
+            // UDP only
+            uint32_t packets_sent = 0, packets_received = 0;
+            uint32_t packets_lost = 0, packets_late = 0;
+
+            uint32_t rtt_samples = 0;
+            uint32_t rtt_last_us = 0, rtt_avg_us = 0, rtt_min_us = 0, rtt_max_us = 0;
+        };
+
+        Multiplayer(Mode mode, const std::string &address, Transport transport = Transport::TCP);
         ~Multiplayer();
 
         void update();
@@ -22,13 +45,25 @@ class Multiplayer final {
 
         void send_message(const uint8_t *data, uint16_t length);
 
+        const Stats &get_stats() const;
+
     private:
         void setup();
         void disconnect();
         void stop_listening();
+        void flush();
+
+        void update_udp();
+        void setup_udp();
+        void disconnect_udp();
+        void handle_udp_packet();
+        void send_udp_packet(uint8_t type, const uint8_t *payload, int length);
+
+        void print_stats();
 
         Mode mode;
         std::string address;
+        Transport transport;
         bool enabled = false, handshake = false;
 
         TCPsocket socket = nullptr, listen_socket = nullptr;
@@ -40,6 +75,30 @@ class Multiplayer final {
         uint8_t head_buf[8];
         int head_off = 0;
 
+        // reused for every message
+        static const int max_message_size = 0xFFFF;
         uint8_t *recv_buf = nullptr;
+        bool receiving = false;
         uint16_t recv_len = 0, recv_off = 0;
+
+        // messages waiting for the end of the tick
+        std::vector<uint8_t> send_buf;
+
+        // UDP
+        static const int udp_header_size = 9; // "32BU", type, sequence
+        static const int udp_batch_size = 1200; // keeps batches under the usual MTU
+        static const int max_udp_packet_size = 65507;
+        static const int hello_interval = 500;
+        static const int ping_interval = 250;
+        static const int udp_timeout = 5000;
+
+        UDPsocket udp_socket = nullptr;
+        UDPpacket *udp_send_packet = nullptr, *udp_recv_packet = nullptr, *udp_control_packet = nullptr;
+        IPaddress peer;
+        bool has_peer = false;
+
+        uint32_t send_sequence = 0, recv_sequence = 0;
+        Uint32 last_hello_time = 0, last_ping_time = 0, last_recv_time = 0;
+
+        Stats stats;
 };
@@ -9,9 +9,9 @@
 #include "Renderer.hpp"
 #include "System.hpp"
 
-Renderer::Renderer(SDL_Window *window, int width, int height) : sys_width(width), sys_height(height) {
+Renderer::Renderer(SDL_Window *window, int width, int height, bool vsync) : sys_width(width), sys_height(height) {
 	//SDL_SetHint(SDL_HINT_RENDER_DRIVER, "openGL");
-	renderer = SDL_CreateRenderer(window, -1, 0);
+	renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
 	if (renderer == nullptr) {
 		std::cerr << "could not create renderer: " << SDL_GetError() << std::endl;
 	}
@@ -32,6 +32,9 @@ Renderer::Renderer(SDL_Window *window, int width, int height) : sys_width(width)
 	fb_hires_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, sys_width, sys_height);
   fb_lores_565_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGR565, SDL_TEXTUREACCESS_STREAMING, sys_width/2, sys_height/2);
   fb_hires_565_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGR565, SDL_TEXTUREACCESS_STREAMING, sys_width, sys_height);
+  // paletted frames are expanded into these when they are locked, see System::update_texture
+  fb_lores_p_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, sys_width/2, sys_height/2);
+  fb_hires_p_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, sys_width, sys_height);
 }
 
 Renderer::~Renderer() {
@@ -39,6 +42,8 @@ Renderer::~Renderer() {
 	SDL_DestroyTexture(fb_hires_texture);
 	SDL_DestroyTexture(fb_lores_565_texture);
 	SDL_DestroyTexture(fb_hires_565_texture);
+	SDL_DestroyTexture(fb_lores_p_texture);
+	SDL_DestroyTexture(fb_hires_p_texture);
 	SDL_DestroyRenderer(renderer);
 }
 
@@ -70,10 +75,14 @@ void Renderer::resize(int width, int height) {
 void Renderer::update(System *sys) {
   auto format = blit::PixelFormat(sys->format());
 
-	if (sys->mode() == 0) {
-		current = format == blit::PixelFormat::RGB565 ? fb_lores_565_texture : fb_lores_texture;
+	bool lores = sys->mode() == 0;
+
+	if (format == blit::PixelFormat::RGB565) {
+		current = lores ? fb_lores_565_texture : fb_hires_565_texture;
+	} else if (format == blit::PixelFormat::P) {
+		current = lores ? fb_lores_p_texture : fb_hires_p_texture;
 	} else {
-		current = format == blit::PixelFormat::RGB565 ? fb_hires_565_texture : fb_hires_texture;
+		current = lores ? fb_lores_texture : fb_hires_texture;
 	}
 
   if(is_lores != (sys->mode() == 0)) {
@@ -84,13 +93,6 @@ void Renderer::update(System *sys) {
 	sys->update_texture(current);
 }
 
-void Renderer::_render(SDL_Texture *target, SDL_Rect *destination) {
-	SDL_SetRenderTarget(renderer, target);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-	SDL_RenderClear(renderer);
-	SDL_RenderCopy(renderer, current, nullptr, destination);
-}
-
 void Renderer::present() {
   SDL_Rect dest;
   dest.x = 0;
@@ -103,14 +105,10 @@ void Renderer::present() {
     dest.h /= 2;
   }
 
-	_render(nullptr, &dest);
+	// straight to the window, the logical size handles the scaling
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+	SDL_RenderClear(renderer);
+	SDL_RenderCopy(renderer, current, nullptr, &dest);
 	SDL_RenderPresent(renderer);
 }
 
-void Renderer::read_pixels(int width, int height, Uint32 format, Uint8 *buffer) {
-	SDL_Texture *record_target = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_TARGET, width, height);
-	_render(record_target, nullptr);
-	SDL_RenderReadPixels(renderer, nullptr, format, buffer, width*SDL_BYTESPERPIXEL(format));
-	SDL_DestroyTexture(record_target);
-}
-
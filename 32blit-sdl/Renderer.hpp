@@ -2,7 +2,7 @@ class System;
 
 class Renderer {
 	public:
-		Renderer(SDL_Window *window, int width, int height);
+		Renderer(SDL_Window *window, int width, int height, bool vsync = false);
 		~Renderer();
 
 		enum Mode {Stretch, KeepAspect, KeepPixels};
@@ -11,11 +11,8 @@ class Renderer {
 		void update(System *sys);
 		void present();
 		void set_mode(Mode mode);
-		void read_pixels(int width, int height, Uint32 format, Uint8 *buffer);
 
 	private:
-		void _render(SDL_Texture *target, SDL_Rect *destination);
-
 		int sys_width, sys_height;
 		int win_width, win_height;
 
@@ -27,5 +24,7 @@ class Renderer {
 		SDL_Texture *fb_hires_texture = nullptr;
 		SDL_Texture *fb_lores_565_texture = nullptr;
 		SDL_Texture *fb_hires_565_texture = nullptr;
+		SDL_Texture *fb_lores_p_texture = nullptr;
+		SDL_Texture *fb_hires_p_texture = nullptr;
 		SDL_Texture *current = nullptr;
 };
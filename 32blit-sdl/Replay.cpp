@@ -0,0 +1,93 @@
+#include <cstring>
+#include <iostream>
+
+#include "Replay.hpp"
+
+// header: "32BR", uint32 version, uint32 random seed
+// followed by entries with the fields written in order, bool as one byte
+static const char replay_magic[4]{'3', '2', 'B', 'R'};
+static const uint32_t replay_version = 1;
+static const size_t replay_entry_size = 4 * 3 + 4 * 5 + 1;
+
+ReplayRecorder::~ReplayRecorder() {
+	close();
+}
+
+bool ReplayRecorder::open(const std::string &filename, uint32_t seed) {
+	close();
+
+	file = fopen(filename.c_str(), "wb");
+	if(!file) {
+		std::cerr << "Could not open " << filename << " for recording" << std::endl;
+		return false;
+	}
+
+	fwrite(replay_magic, 1, 4, file);
+	fwrite(&replay_version, 4, 1, file);
+	fwrite(&seed, 4, 1, file);
+
+	return true;
+}
+
+void ReplayRecorder::add(const ReplayEntry &entry) {
+	if(!file)
+		return;
+
+	uint8_t buf[replay_entry_size];
+	auto p = buf;
+
+	memcpy(p, &entry.time, 4); p += 4;
+	memcpy(p, &entry.tick_time, 4); p += 4;
+	memcpy(p, &entry.buttons, 4); p += 4;
+	memcpy(p, entry.joystick, 4 * 2); p += 4 * 2;
+	memcpy(p, entry.tilt, 4 * 3); p += 4 * 3;
+	*p = entry.rendered ? 1 : 0;
+
+	fwrite(buf, 1, replay_entry_size, file);
+}
+
+void ReplayRecorder::close() {
+	if(file)
+		fclose(file);
+
+	file = nullptr;
+}
+
+bool read_replay(const std::string &filename, uint32_t &seed, std::vector<ReplayEntry> &entries) {
+	auto file = fopen(filename.c_str(), "rb");
+	if(!file) {
+		std::cerr << "Could not open " << filename << std::endl;
+		return false;
+	}
+
+	char magic[4];
+	uint32_t version;
+
+	if(fread(magic, 1, 4, file) != 4 || memcmp(magic, replay_magic, 4) != 0
+	|| fread(&version, 4, 1, file) != 1 || version != replay_version
+	|| fread(&seed, 4, 1, file) != 1) {
+		std::cerr << filename << " is not a supported replay" << std::endl;
+		fclose(file);
+		return false;
+	}
+
+	entries.clear();
+
+	uint8_t buf[replay_entry_size];
+	while(fread(buf, 1, replay_entry_size, file) == replay_entry_size) {
+		ReplayEntry entry;
+		auto p = buf;
+
+		memcpy(&entry.time, p, 4); p += 4;
+		memcpy(&entry.tick_time, p, 4); p += 4;
+		memcpy(&entry.buttons, p, 4); p += 4;
+		memcpy(entry.joystick, p, 4 * 2); p += 4 * 2;
+		memcpy(entry.tilt, p, 4 * 3); p += 4 * 3;
+		entry.rendered = *p != 0;
+
+		entries.push_back(entry);
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The timing and input of one pass of the system loop, recorded so that a session can be replayed exactly
+struct ReplayEntry {
+	uint32_t time;      // passed to render
+	uint32_t tick_time; // passed to tick
+	uint32_t buttons;
+	float joystick[2];
+	float tilt[3];
+	bool rendered;
+};
+
+class ReplayRecorder {
+	public:
+		~ReplayRecorder();
+
+		bool open(const std::string &filename, uint32_t seed);
+		void add(const ReplayEntry &entry);
+		void close();
+
+	private:
+		FILE *file = nullptr;
+};
+
+bool read_replay(const std::string &filename, uint32_t &seed, std::vector<ReplayEntry> &entries);
@@ -1,11 +1,16 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <random>
+#include <thread>
 #include "SDL.h"
 
 #include "File.hpp"
+#include "FrameDump.hpp"
 #include "System.hpp"
 #include "Input.hpp"
+#include "Audio.hpp"
 #include "32blit.hpp"
 #include "UserCode.hpp"
 #include "JPEG.hpp"
@@ -18,10 +23,36 @@ extern Input *blit_input;
 int System::width = System::max_width;
 int System::height = System::max_height;
 
+int System::render_rate = 50;
+bool System::precise_timing = false;
+
+// the engine needs tick() called at least this often
+static const Uint32 max_loop_period_us = 10000;
+
+// sleeping is only accurate to a millisecond or two, with precise_timing spin for the end of each wait
+// (this keeps a core busy for spin_time_ms of every loop period)
+static const Uint32 spin_time_ms = 2;
+
 // blit framebuffer memory
 static uint8_t framebuffer[System::max_width * System::max_height * 3];
 static blit::Pen palette[256];
 
+// finished frames, handed from the loop to the main thread without either waiting for the other
+struct Frame {
+  blit::ScreenMode mode = blit::ScreenMode::lores;
+  blit::PixelFormat format = blit::PixelFormat::RGB;
+  blit::Pen palette[256];
+  uint8_t data[System::max_width * System::max_height * 3];
+};
+
+// triple buffered, the loop fills one frame while the main thread displays another and the third holds the newest
+// finished frame. The flag is set in ready_frame when it hasn't been taken by the main thread yet.
+static Frame frames[3];
+static const int new_frame_flag = 4;
+static std::atomic<int> ready_frame(1);
+static int write_frame = 0; // loop thread
+static int display_frame = 2; // main thread
+
 // blit debug callback
 void blit_debug(const char *message) {
 	std::cout << message;
@@ -89,11 +120,23 @@ blit::SurfaceInfo &set_screen_mode(blit::ScreenMode new_mode) {
 
 // blit timer callback
 std::chrono::steady_clock::time_point start;
-uint32_t now() {
+
+// headless runs use a virtual clock that advances by one frame per render, recording pins it to the recorded times
+static bool use_virtual_time = false;
+static uint32_t virtual_time = 0;
+
+static uint32_t wall_time() {
 	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
 	return (uint32_t)elapsed.count();
 }
 
+uint32_t now() {
+	if(use_virtual_time)
+		return virtual_time;
+
+	return wall_time();
+}
+
 // blit random callback
 #ifdef __MINGW32__
 // Windows/MinGW doesn't support a non-deterministic source of randomness, so we fall back upon the age-old time seed once more
@@ -149,6 +192,7 @@ static blit::GameMetadata get_metadata() {
 }
 
 extern Multiplayer *blit_multiplayer;
+extern Audio *blit_audio;
 bool blit_is_multiplayer_connected() {
 	return blit_multiplayer->is_connected();
 }
@@ -181,24 +225,18 @@ static int system_loop_thread(void *ptr) {
 #endif
 
 System::System() {
-	m_input = SDL_CreateMutex();
 	s_timer_stop = SDL_CreateSemaphore(0);
 	s_loop_update = SDL_CreateSemaphore(0);
-	s_loop_redraw = SDL_CreateSemaphore(0);
 	s_loop_ended = SDL_CreateSemaphore(0);
 }
 
 System::~System() {
-	SDL_DestroyMutex(m_input);
 	SDL_DestroySemaphore(s_timer_stop);
 	SDL_DestroySemaphore(s_loop_update);
-	SDL_DestroySemaphore(s_loop_redraw);
 	SDL_DestroySemaphore(s_loop_ended);
 }
 
-void System::run() {
-	running = true;
-
+void System::init_api() {
 	start = std::chrono::steady_clock::now();
 
 	blit::api.now = ::now;
@@ -242,6 +280,20 @@ void System::run() {
   blit::api.get_metadata = ::get_metadata;
 
 	blit::set_screen_mode(blit::lores);
+}
+
+void System::run() {
+	running = true;
+
+	auto freq = SDL_GetPerformanceFrequency();
+	render_period = freq / std::max(render_rate, 1);
+
+	// split each frame into equal loops so renders line up with them
+	auto max_loop_period = freq * max_loop_period_us / 1000000;
+	loop_period = render_period / ((render_period + max_loop_period - 1) / max_loop_period);
+	next_render_time = SDL_GetPerformanceCounter();
+
+	init_api();
 
 #ifdef __EMSCRIPTEN__
 	::init();
@@ -251,17 +303,254 @@ void System::run() {
 #endif
 }
 
+// convert a frame to RGB24, scaling up by scale x scale
+void convert_to_rgb(const uint8_t *data, blit::PixelFormat format, const blit::Pen *pal, int w, int h, int scale, uint8_t *out) {
+  auto out_stride = w * scale * 3;
+
+  for(int y = 0; y < h; y++) {
+    auto out_row = out + y * scale * out_stride;
+    auto out_ptr = out_row;
+
+    for(int x = 0; x < w; x++) {
+      auto i = y * w + x;
+      uint8_t rgb[3];
+
+      switch(format) {
+        case blit::PixelFormat::RGB:
+          memcpy(rgb, data + i * 3, 3);
+          break;
+        case blit::PixelFormat::RGB565: {
+          uint16_t p;
+          memcpy(&p, data + i * 2, 2);
+          rgb[0] = (p & 0x1F) << 3;
+          rgb[1] = ((p >> 5) & 0x3F) << 2;
+          rgb[2] = (p >> 11) << 3;
+          break;
+        }
+        case blit::PixelFormat::P: {
+          auto &pen = pal[data[i]];
+          rgb[0] = pen.r;
+          rgb[1] = pen.g;
+          rgb[2] = pen.b;
+          break;
+        }
+        default:
+          rgb[0] = rgb[1] = rgb[2] = 0;
+          break;
+      }
+
+      for(int s = 0; s < scale; s++) {
+        memcpy(out_ptr, rgb, 3);
+        out_ptr += 3;
+      }
+    }
+
+    for(int s = 1; s < scale; s++)
+      memcpy(out_row + s * out_stride, out_row, out_stride);
+  }
+}
+
+int System::run_headless(int num_frames, const char *stats_path, const char *dump_path, int dump_interval, const char *hash_path) {
+	running = true;
+
+	// fixed clock and random seed so that runs are repeatable
+	use_virtual_time = true;
+	virtual_time = 0;
+	random_generator.seed(replaying ? replay_seed : 0x32B17);
+
+	init_api();
+	::init();
+
+	FILE *stats_file = nullptr;
+	if(stats_path) {
+		stats_file = fopen(stats_path, "w");
+		if(!stats_file) {
+			std::cerr << "Could not open " << stats_path << std::endl;
+			return 1;
+		}
+		fprintf(stats_file, "frame,time_ms,render_us,tick_us,updates,audio_us\n");
+	}
+
+	FrameDump frame_dump(dump_path, dump_interval, hash_path);
+	if(!frame_dump.ok())
+		return 1;
+
+	blit::reset_frame_stats();
+
+	auto rate = std::max(render_rate, 1);
+	uint64_t audio_samples = 0;
+	uint64_t total_tick_us = 0;
+	auto run_start = SDL_GetPerformanceCounter();
+
+	int frames_rendered = 0;
+
+	// without a replay, render at the render rate and tick at least every 10ms, like the threaded loop
+	size_t replay_pos = 0;
+	uint32_t next_time = 0, next_frame_time = 0;
+
+	auto next_entry = [&](ReplayEntry &entry) {
+		if(replaying) {
+			if(replay_pos == replay.size())
+				return false;
+
+			entry = replay[replay_pos++];
+			return true;
+		}
+
+		entry = ReplayEntry{};
+		entry.time = entry.tick_time = next_time;
+		entry.rendered = next_time >= next_frame_time;
+
+		if(entry.rendered)
+			next_frame_time = uint32_t(uint64_t(frames_rendered + 1) * 1000 / rate);
+
+		next_time = std::min(next_time + max_loop_period_us / 1000, next_frame_time);
+		return true;
+	};
+
+	// per-frame stats, written when the next frame starts
+	uint32_t frame_time = 0, render_us = 0, tick_us = 0, updates = 0, audio_us = 0;
+
+	auto write_stats = [&]() {
+		if(stats_file && frames_rendered)
+			fprintf(stats_file, "%i,%u,%u,%u,%u,%u\n", frames_rendered - 1, frame_time, render_us, tick_us, updates, audio_us);
+	};
+
+	ReplayEntry entry;
+
+	while(running && next_entry(entry)) {
+		if(entry.rendered && num_frames >= 0 && frames_rendered == num_frames)
+			break;
+
+		blit::buttons = entry.buttons;
+		blit::joystick = blit::Vec2(entry.joystick[0], entry.joystick[1]);
+		blit::tilt = blit::Vec3(entry.tilt[0], entry.tilt[1], entry.tilt[2]);
+
+		if(entry.rendered) {
+			write_stats();
+
+			frame_time = virtual_time = entry.time;
+			tick_us = updates = audio_us = 0;
+
+			auto render_start_us = blit::now_us();
+			blit::render(virtual_time);
+			render_us = blit::us_diff(render_start_us, blit::now_us());
+			blit::frame_stats_render(render_us);
+
+			if(_mode != requested_mode || cur_format != requested_format) {
+				_mode = requested_mode;
+				cur_format = requested_format;
+			}
+
+			bool is_lores = _mode == blit::ScreenMode::lores;
+			frame_dump.add(frames_rendered, framebuffer, cur_format, palette, is_lores ? width / 2 : width, is_lores ? height / 2 : height);
+
+			frames_rendered++;
+		}
+
+		virtual_time = entry.tick_time;
+
+		auto tick_start_us = blit::now_us();
+		blit::tick(virtual_time);
+		auto this_tick_us = blit::us_diff(tick_start_us, blit::now_us());
+		tick_us += this_tick_us;
+		total_tick_us += this_tick_us;
+		updates += blit::get_frame_stats().updates.last();
+
+		blit_multiplayer->update();
+
+		// mix the audio that would have played up to now
+		auto target_samples = uint64_t(virtual_time) * blit::sample_rate / 1000;
+		if(target_samples > audio_samples) {
+			auto audio_start_us = blit::now_us();
+			for(; audio_samples < target_samples; audio_samples++)
+				blit::get_audio_frame();
+			auto mix_us = blit::us_diff(audio_start_us, blit::now_us());
+			audio_us += mix_us;
+			blit::frame_stats_audio(mix_us);
+		}
+	}
+
+	write_stats();
+
+	frame_dump.finish();
+
+	if(stats_file)
+		fclose(stats_file);
+
+	auto run_ms = (SDL_GetPerformanceCounter() - run_start) * 1000 / SDL_GetPerformanceFrequency();
+	auto &stats = blit::get_frame_stats();
+
+	std::cout << "Ran " << frames_rendered << " frames in " << run_ms << "ms" << std::endl;
+	std::cout << " render: avg " << stats.render_us.average() << "us, p95 " << stats.render_us.percentile(95) << "us, max " << stats.render_us.max << "us" << std::endl;
+	std::cout << " tick:   avg " << (frames_rendered ? total_tick_us / frames_rendered : 0) << "us, dropped " << stats.dropped_frames << std::endl;
+	std::cout << " audio:  avg " << stats.audio_us.average() << "us, max " << stats.audio_us.max << "us" << std::endl;
+
+	running = false;
+	return 0;
+}
+
+bool System::start_recording(const std::string &filename) {
+	// a new seed for each recording, saved so the replay gets the same random numbers
+	std::random_device seed_device;
+	uint32_t seed = seed_device();
+
+	if(!recorder.open(filename, seed))
+		return false;
+
+	random_generator.seed(seed);
+	recording = true;
+	return true;
+}
+
+bool System::load_replay(const std::string &filename) {
+	replaying = read_replay(filename, replay_seed, replay);
+	return replaying;
+}
+
 int System::timer_thread() {
-	// Signal the system loop every 10 msec.
+	// Signal the system loop at least every 10 msec, in step with the render rate.
 	int dropped = 0;
 	SDL_Event event = {};
 	event.type = timer_event;
 
-	while (SDL_SemWaitTimeout(s_timer_stop, 10)) {
+	auto freq = SDL_GetPerformanceFrequency();
+	int frozen_count = int(freq / loop_period); // ~1 second
+
+	// signal on a fixed schedule so the rate doesn't drift
+	auto next_time = SDL_GetPerformanceCounter() + loop_period;
+
+	while (true) {
+		auto time = SDL_GetPerformanceCounter();
+
+		if (time < next_time) {
+			Uint32 wait_ms = Uint32((next_time - time) * 1000 / freq);
+			Uint32 spin_ms = precise_timing ? spin_time_ms : 0;
+
+			if (wait_ms > spin_ms && SDL_SemWaitTimeout(s_timer_stop, wait_ms - spin_ms) == 0)
+				break;
+
+			// otherwise up to a millisecond early, the schedule still doesn't drift
+			if (precise_timing) {
+				while (SDL_GetPerformanceCounter() < next_time)
+					std::this_thread::yield();
+			}
+		}
+
+		if (SDL_SemTryWait(s_timer_stop) == 0)
+			break;
+
+		next_time += loop_period;
+
+		// too far behind, restart the schedule instead of signalling repeatedly
+		time = SDL_GetPerformanceCounter();
+		if (time > next_time)
+			next_time = time + loop_period;
+
 		if (SDL_SemValue(s_loop_update)) {
 			dropped++;
-			if(dropped > 100) {
-				dropped = 100;
+			if(dropped > frozen_count) {
+				dropped = frozen_count;
 				event.user.code = 2;
 				SDL_PushEvent(&event);
 			} else {
@@ -288,105 +577,211 @@ int System::update_thread() {
 	while (true) {
 		SDL_SemWait(s_loop_update);
 		if(!running) break;
-		loop();
+		bool rendered = loop();
 		if(!running) break;
-		SDL_PushEvent(&event);
-		SDL_SemWait(s_loop_redraw);
+
+		// keep going while the main thread presents, only one event needs to be queued
+		if(rendered && !redraw_pending.exchange(true))
+			SDL_PushEvent(&event);
 	}
 	SDL_SemPost(s_loop_ended);
 	return 0;
 }
 
-void System::loop() {
-  SDL_LockMutex(m_input);
-  blit::buttons = shadow_buttons;
-  blit::tilt.x = shadow_tilt[0];
-  blit::tilt.y = shadow_tilt[1];
-  blit::tilt.z = shadow_tilt[2];
-  blit::joystick.x = shadow_joystick[0];
-  blit::joystick.y = shadow_joystick[1];
-  SDL_UnlockMutex(m_input);
+static void publish_frame() {
+  auto &frame = frames[write_frame];
+
+  frame.mode = _mode;
+  frame.format = cur_format;
+
+  bool is_lores = _mode == blit::ScreenMode::lores;
+  auto size = is_lores ? (System::width / 2) * (System::height / 2) : System::width * System::height;
+  memcpy(frame.data, framebuffer, size * blit::pixel_format_stride[int(cur_format)]);
+
+  if(cur_format == blit::PixelFormat::P)
+    memcpy(frame.palette, palette, sizeof(palette));
+
+  // swap with the ready frame, getting back either the old ready frame or the one the main thread was displaying
+  write_frame = ready_frame.exchange(write_frame | new_frame_flag, std::memory_order_acq_rel) & ~new_frame_flag;
+}
 
-  // only render at 50Hz (main loop runs at 100Hz)
+// returns true if a frame was rendered
+bool System::loop() {
+  // copy the input without blocking the event thread, retrying if it changed part way through
+  Uint32 sequence, buttons;
+  blit::Vec3 tilt;
+  blit::Vec2 joystick;
+
+  do {
+    sequence = input_sequence.load(std::memory_order_acquire);
+
+    buttons = shadow_buttons.load(std::memory_order_relaxed);
+    tilt.x = shadow_tilt[0].load(std::memory_order_relaxed);
+    tilt.y = shadow_tilt[1].load(std::memory_order_relaxed);
+    tilt.z = shadow_tilt[2].load(std::memory_order_relaxed);
+    joystick.x = shadow_joystick[0].load(std::memory_order_relaxed);
+    joystick.y = shadow_joystick[1].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while((sequence & 1) || sequence != input_sequence.load(std::memory_order_relaxed));
+
+  blit::buttons = buttons;
+  blit::tilt = tilt;
+  blit::joystick = joystick;
+
+  blit_audio->update_stats();
+
+  // only render at the render rate (main loop runs at least every 10ms)
   // however, the emscripten loop (usually) runs at the display refresh rate
-  auto time_now = ::now();
+  // while recording, anything the game reads from now() has to match what a replay will see
+  auto time_now = wall_time();
+  if(recording) {
+    use_virtual_time = true;
+    virtual_time = time_now;
+  }
+
+  bool rendered = false;
 #ifndef __EMSCRIPTEN__
-  if(time_now - last_render_time >= 20)
+  // allow the loop to be a little early
+  auto counter = SDL_GetPerformanceCounter();
+  if(counter + loop_period / 2 >= next_render_time)
 #endif
   {
+#ifndef __EMSCRIPTEN__
+    next_render_time += render_period;
+    if(next_render_time < counter)
+      next_render_time = counter + render_period;
+#endif
+
+    auto render_start_us = blit::now_us();
     blit::render(time_now);
-    last_render_time = time_now;
+    blit::frame_stats_render(blit::us_diff(render_start_us, blit::now_us()));
 
     if(_mode != requested_mode || cur_format != requested_format) {
       _mode = requested_mode;
       cur_format = requested_format;
     }
+
+    publish_frame();
+    rendered = true;
   }
 
-  blit::tick(::now());
+  auto tick_time = wall_time();
+  virtual_time = tick_time;
+
+  blit::tick(tick_time);
   blit_input->rumble_controllers(blit::vibration);
 
+  if(recording) {
+    ReplayEntry entry{time_now, tick_time, buttons, {joystick.x, joystick.y}, {tilt.x, tilt.y, tilt.z}, rendered};
+    recorder.add(entry);
+  }
+
   blit_multiplayer->update();
+
+  if(recording)
+    use_virtual_time = false;
+
+  return rendered;
 }
 
+// mode/format of the frame being displayed
 Uint32 System::mode() {
-	return _mode;
+	return frames[display_frame].mode;
 }
 
 Uint32 System::format() {
-	return Uint32(cur_format);
+	return Uint32(frames[display_frame].format);
 }
 
 void System::update_texture(SDL_Texture *texture) {
-  bool is_lores = _mode == blit::ScreenMode::lores;
-  auto stride = (is_lores ? width / 2 : width) * blit::pixel_format_stride[int(cur_format)];
-
-  if(cur_format == blit::PixelFormat::P) {
-    uint8_t col_fb[max_width * max_height * 3];
-
-    auto in = framebuffer, out = col_fb;
-    auto size = is_lores ? (width / 2) * (height / 2) : width * height;
-
-    for(int i = 0; i < size; i++) {
-      uint8_t index = *(in++);
-      (*out++) = palette[index].r;
-      (*out++) = palette[index].g;
-      (*out++) = palette[index].b;
+  auto &frame = frames[display_frame];
+  bool is_lores = frame.mode == blit::ScreenMode::lores;
+  auto stride = (is_lores ? width / 2 : width) * blit::pixel_format_stride[int(frame.format)];
+
+  if(frame.format == blit::PixelFormat::P) {
+    // expand straight into the texture, using 32-bit pixels so that each one is a single store
+    uint32_t lookup[256];
+    for(int i = 0; i < 256; i++)
+      lookup[i] = frame.palette[i].r << 16 | frame.palette[i].g << 8 | frame.palette[i].b;
+
+    void *pixels;
+    int pitch;
+    if(SDL_LockTexture(texture, nullptr, &pixels, &pitch) != 0)
+      return;
+
+    int w = is_lores ? width / 2 : width;
+    int h = is_lores ? height / 2 : height;
+    auto in = frame.data;
+
+    for(int y = 0; y < h; y++) {
+      auto out = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(pixels) + y * pitch);
+
+      for(int x = 0; x < w; x++)
+        out[x] = lookup[*(in++)];
     }
 
-    SDL_UpdateTexture(texture, nullptr, col_fb, stride * 3);
+    SDL_UnlockTexture(texture);
   } else
-    SDL_UpdateTexture(texture, nullptr, framebuffer, stride);
+    SDL_UpdateTexture(texture, nullptr, frame.data, stride);
 }
 
-void System::notify_redraw() {
-	SDL_SemPost(s_loop_redraw);
+// copy the frame being displayed as width x height RGB24, lores frames are doubled
+void System::read_frame(uint8_t *rgb) {
+  auto &frame = frames[display_frame];
+  bool is_lores = frame.mode == blit::ScreenMode::lores;
+  int scale = is_lores ? 2 : 1;
+
+  convert_to_rgb(frame.data, frame.format, frame.palette, width / scale, height / scale, scale, rgb);
+}
+
+// called by the main thread to switch to the newest finished frame, returns false if there isn't a new one
+bool System::take_frame() {
+	redraw_pending = false;
+
+	if(!(ready_frame.load(std::memory_order_relaxed) & new_frame_flag))
+		return false;
+
+	display_frame = ready_frame.exchange(display_frame, std::memory_order_acq_rel) & ~new_frame_flag;
+	return true;
 }
 
 void System::set_joystick(int axis, float value) {
 	if (axis < 2) {
-		SDL_LockMutex(m_input);
-		shadow_joystick[axis] = value;
-		SDL_UnlockMutex(m_input);
+		begin_input_write();
+		shadow_joystick[axis].store(value, std::memory_order_relaxed);
+		end_input_write();
 	}
 }
 
 void System::set_tilt(int axis, float value) {
 	if (axis < 3) {
-		SDL_LockMutex(m_input);
-		shadow_tilt[axis] = value;
-		SDL_UnlockMutex(m_input);
+		begin_input_write();
+		shadow_tilt[axis].store(value, std::memory_order_relaxed);
+		end_input_write();
 	}
 }
 
 void System::set_button(int button, bool state) {
-	SDL_LockMutex(m_input);
+	// only the event thread writes, so this doesn't need to be an atomic read-modify-write
+	auto buttons = shadow_buttons.load(std::memory_order_relaxed);
+
+	begin_input_write();
 	if (state) {
-		shadow_buttons |= button;
+		shadow_buttons.store(buttons | button, std::memory_order_relaxed);
 	} else {
-		shadow_buttons &= ~button;
+		shadow_buttons.store(buttons & ~button, std::memory_order_relaxed);
 	}
-	SDL_UnlockMutex(m_input);
+	end_input_write();
+}
+
+void System::begin_input_write() {
+	input_sequence.store(input_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void System::end_input_write() {
+	input_sequence.store(input_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
 }
 
 void System::stop() {
@@ -1,3 +1,10 @@
+#include <atomic>
+#include <cstdint>
+
+#include "graphics/surface.hpp"
+
+#include "Replay.hpp"
+
 class System {
 	public:
 		static const Uint32 timer_event;
@@ -9,45 +16,72 @@ class System {
 		static int width;
 		static int height;
 
+		static int render_rate; // Hz
+		static bool precise_timing; // spin for the end of each wait instead of only sleeping
+
 		System();
 		~System();
 
 		void run();
+		int run_headless(int num_frames, const char *stats_path, const char *dump_path, int dump_interval, const char *hash_path);
 		void stop();
 
+		bool start_recording(const std::string &filename);
+		bool load_replay(const std::string &filename);
+
 		int update_thread();
 		int timer_thread();
 
-		void loop();
+		bool loop();
 
 		Uint32 mode();
     Uint32 format();
 
 		void update_texture(SDL_Texture *);
-		void notify_redraw();
+		bool take_frame();
+		void read_frame(uint8_t *rgb);
 
 		void set_joystick(int axis, float value);
 		void set_tilt(int axis, float value);
 		void set_button(int button, bool state);
 
 	private:
+		void init_api();
 
 		SDL_Thread *t_system_timer = nullptr;
 		SDL_Thread *t_system_loop = nullptr;
 
-		SDL_mutex *m_input = nullptr;
-
 		SDL_sem *s_timer_stop = nullptr;
 		SDL_sem *s_loop_update = nullptr;
-		SDL_sem *s_loop_redraw = nullptr;
 		SDL_sem *s_loop_ended = nullptr;
 
 		bool running = false;
 
-		Uint32 last_render_time = 0;
+		// input recording/replay
+		ReplayRecorder recorder;
+		bool recording = false;
 
-		// shadow input
-		Uint32 shadow_buttons = 0;
-		float shadow_joystick[2] = {0, 0};
-		float shadow_tilt[3] = {0, 0, 0};
+		std::vector<ReplayEntry> replay;
+		uint32_t replay_seed = 0;
+		bool replaying = false;
+
+		// set when the main thread has a loop_event to handle
+		std::atomic<bool> redraw_pending{false};
+
+		// performance counter ticks
+		Uint64 loop_period = 0;
+		Uint64 render_period = 0;
+		Uint64 next_render_time = 0;
+
+		void begin_input_write();
+		void end_input_write();
+
+		// shadow input, written by the event thread and read by the loop
+		// the sequence is odd while a write is in progress (seqlock)
+		std::atomic<Uint32> input_sequence{0};
+		std::atomic<Uint32> shadow_buttons{0};
+		std::atomic<float> shadow_joystick[2] = {{0}, {0}};
+		std::atomic<float> shadow_tilt[3] = {{0}, {0}, {0}};
 };
+
+void convert_to_rgb(const uint8_t *data, blit::PixelFormat format, const blit::Pen *pal, int w, int h, int scale, uint8_t *out);
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <iostream>
@@ -5,7 +6,6 @@
 
 #include "VideoCapture.hpp"
 
-#include "Renderer.hpp"
 #include "System.hpp"
 
 #include "VideoCaptureFfmpeg.hpp"
@@ -26,8 +26,15 @@ inline std::tm localtime_xp(std::time_t timer)
 	return bt;
 }
 
+static int video_capture_encode_thread(void *ptr) {
+	// Bounce back in to the class.
+	VideoCapture *capture = (VideoCapture *)ptr;
+	return capture->encode_thread();
+}
+
 VideoCapture::VideoCapture(const char *name) : name(name) {
-	;
+	m_queue = SDL_CreateMutex();
+	c_queue = SDL_CreateCond();
 }
 
 VideoCapture::~VideoCapture() {
@@ -35,11 +42,24 @@ VideoCapture::~VideoCapture() {
 		std::cerr << "Warning: recording was not stopped before exiting." << std::endl;
 		stop();
 	}
+
+	SDL_DestroyCond(c_queue);
+	SDL_DestroyMutex(m_queue);
 }
 
 void VideoCapture::start(const char *filename) {
-	buffer = (Uint8 *)malloc(System::width * System::height * SDL_BYTESPERPIXEL(SDL_PIXELFORMAT_RGB24));
+	auto frame_size = System::width * System::height * SDL_BYTESPERPIXEL(SDL_PIXELFORMAT_RGB24);
+
+	buffer = (Uint8 *)malloc(frame_size);
+	for (auto &frame : queue)
+		frame = (Uint8 *)malloc(frame_size);
+
+	queue_read = queue_count = 0;
+	dropped = 0;
+	stopping = false;
+
 	ffmpeg_open_stream(filename, System::width, System::height, buffer);
+	t_encode = SDL_CreateThread(video_capture_encode_thread, "Encode", (void *)this);
 	std::cerr << "Started with filename " << filename << std::endl;
 }
 
@@ -51,18 +71,79 @@ void VideoCapture::start() {
 	start(filename.str().c_str());
 }
 
-void VideoCapture::capture(Renderer *source) {
-	if (buffer) {
-		source->read_pixels(System::width, System::height, SDL_PIXELFORMAT_RGB24, buffer);
-		ffmpeg_capture();
-	} else {
+void VideoCapture::capture(System *source) {
+	if (!buffer) {
 		std::cerr << "Not recording" << std::endl;
+		return;
+	}
+
+	SDL_LockMutex(m_queue);
+	bool full = queue_count == queue_size;
+	int slot = (queue_read + queue_count) % queue_size;
+	SDL_UnlockMutex(m_queue);
+
+	// the encoder is behind, drop the frame rather than slowing down the game
+	if (full) {
+		dropped++;
+		return;
 	}
+
+	// the encoder doesn't touch this slot until it's added to the count
+	source->read_frame(queue[slot]);
+
+	SDL_LockMutex(m_queue);
+	queue_count++;
+	SDL_CondSignal(c_queue);
+	SDL_UnlockMutex(m_queue);
 }
 
 void VideoCapture::stop() {
+	// finish encoding the queued frames
+	SDL_LockMutex(m_queue);
+	stopping = true;
+	SDL_CondSignal(c_queue);
+	SDL_UnlockMutex(m_queue);
+
+	SDL_WaitThread(t_encode, nullptr);
+	t_encode = nullptr;
+
 	ffmpeg_close_stream();
+
 	free(buffer);
 	buffer = NULL;
+
+	for (auto &frame : queue) {
+		free(frame);
+		frame = NULL;
+	}
+
+	if (dropped)
+		std::cerr << "Dropped " << dropped << " frames." << std::endl;
 	std::cerr << "Stopped." << std::endl;
 }
+
+int VideoCapture::encode_thread() {
+	while (true) {
+		SDL_LockMutex(m_queue);
+		while (queue_count == 0 && !stopping)
+			SDL_CondWait(c_queue, m_queue);
+
+		if (queue_count == 0) {
+			SDL_UnlockMutex(m_queue);
+			break;
+		}
+
+		auto frame = queue[queue_read];
+		SDL_UnlockMutex(m_queue);
+
+		memcpy(buffer, frame, System::width * System::height * SDL_BYTESPERPIXEL(SDL_PIXELFORMAT_RGB24));
+		ffmpeg_capture();
+
+		SDL_LockMutex(m_queue);
+		queue_read = (queue_read + 1) % queue_size;
+		queue_count--;
+		SDL_UnlockMutex(m_queue);
+	}
+
+	return 0;
+}
@@ -1,4 +1,4 @@
-class Renderer;
+class System;
 
 class VideoCapture {
 	public:
@@ -7,11 +7,25 @@ class VideoCapture {
 
 		void start(const char *filename);
 		void start();
-		void capture(Renderer *source);
+		void capture(System *source);
 		void stop();
 		bool recording() {return buffer;}
 
+		int encode_thread();
+
 	private:
+		static const int queue_size = 8;
+
 		const char *name;
-		Uint8 *buffer = NULL;
+		Uint8 *buffer = NULL; // read by the encoder
+
+		// frames waiting to be encoded, capture drops frames instead of waiting when this is full
+		Uint8 *queue[queue_size] = {};
+		int queue_read = 0, queue_count = 0;
+		int dropped = 0;
+		bool stopping = false;
+
+		SDL_mutex *m_queue = nullptr;
+		SDL_cond *c_queue = nullptr;
+		SDL_Thread *t_encode = nullptr;
 };
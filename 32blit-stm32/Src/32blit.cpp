@@ -56,6 +56,9 @@ static bool user_code_disabled = false;
 static bool in_user_code = false;
 static bool game_switch_requested = false;
 
+// shared with user code through the API
+static blit::FrameStats frame_stats;
+
 // flash cache, most of this is hanlded by the firmware. This needs to be here so switch_execution can reset it
 bool cached_file_in_tmp = false;
 
@@ -85,6 +88,8 @@ static void init_api_shared() {
   api.message_received = nullptr;
   api.i2c_completed = nullptr;
 
+  blit::reset_frame_stats();
+
   // take CDC back
   g_commandStream.SetParsingEnabled(true);
 }
@@ -183,7 +188,9 @@ static GameMetadata get_metadata() {
 
 static void do_render() {
   if(display::needs_render) {
+    auto start_us = blit::now_us();
     blit::render(blit::now());
+    blit::frame_stats_render(blit::us_diff(start_us, blit::now_us()));
     display::enable_vblank_interrupt();
   }
 }
@@ -411,6 +418,8 @@ void blit_init() {
 
   blit::api.tick_function_changed = false;
 
+  blit::api.frame_stats = &frame_stats;
+
   blit::api.i2c_send = i2c::user_send;
   blit::api.i2c_receive = i2c::user_receive;
 
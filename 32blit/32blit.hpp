@@ -6,14 +6,18 @@
 #include "engine/engine.hpp"
 #include "engine/fast_code.hpp"
 #include "engine/file.hpp"
+#include "engine/frame_stats.hpp"
 #include "engine/input.hpp"
 #include "engine/menu.hpp"
 #include "engine/multiplayer.hpp"
 #include "engine/output.hpp"
 #include "engine/particle.hpp"
+#include "engine/profile_zone.hpp"
 #include "engine/profiler.hpp"
+#include "engine/rollback.hpp"
 #include "engine/running_average.hpp"
 #include "engine/save.hpp"
+#include "engine/state_sync.hpp"
 #include "engine/timer.hpp"
 #include "engine/tweening.hpp"
 #include "engine/version.hpp"
@@ -23,6 +27,7 @@
 #include "graphics/jpeg.hpp"
 #include "graphics/mode7.hpp"
 #include "graphics/surface.hpp"
+#include "graphics/text_layout.hpp"
 #include "graphics/tilemap.hpp"
 #include "math/constants.hpp"
 #include "math/interpolation.hpp"
@@ -1,8 +1,12 @@
 /*! \file audio.cpp
     \brief Audio engine
 */
+#include <algorithm>
+#include <cstring>
+
 #include "../engine/engine.hpp"
 #include "../engine/input.hpp"
+#include "../engine/profile_zone.hpp"
 #include "../32blit.hpp"
 
 #include "audio.hpp"
@@ -31,6 +35,239 @@ namespace blit {
   uint16_t volume = 0xffff;
   const int16_t sine_waveform[256] = {-32768,-32758,-32729,-32679,-32610,-32522,-32413,-32286,-32138,-31972,-31786,-31581,-31357,-31114,-30853,-30572,-30274,-29957,-29622,-29269,-28899,-28511,-28106,-27684,-27246,-26791,-26320,-25833,-25330,-24812,-24279,-23732,-23170,-22595,-22006,-21403,-20788,-20160,-19520,-18868,-18205,-17531,-16846,-16151,-15447,-14733,-14010,-13279,-12540,-11793,-11039,-10279,-9512,-8740,-7962,-7180,-6393,-5602,-4808,-4011,-3212,-2411,-1608,-804,0,804,1608,2411,3212,4011,4808,5602,6393,7180,7962,8740,9512,10279,11039,11793,12540,13279,14010,14733,15447,16151,16846,17531,18205,18868,19520,20160,20788,21403,22006,22595,23170,23732,24279,24812,25330,25833,26320,26791,27246,27684,28106,28511,28899,29269,29622,29957,30274,30572,30853,31114,31357,31581,31786,31972,32138,32286,32413,32522,32610,32679,32729,32758,32767,32758,32729,32679,32610,32522,32413,32286,32138,31972,31786,31581,31357,31114,30853,30572,30274,29957,29622,29269,28899,28511,28106,27684,27246,26791,26320,25833,25330,24812,24279,23732,23170,22595,22006,21403,20788,20160,19520,18868,18205,17531,16846,16151,15447,14733,14010,13279,12540,11793,11039,10279,9512,8740,7962,7180,6393,5602,4808,4011,3212,2411,1608,804,0,-804,-1608,-2411,-3212,-4011,-4808,-5602,-6393,-7180,-7962,-8740,-9512,-10279,-11039,-11793,-12540,-13279,-14010,-14733,-15447,-16151,-16846,-17531,-18205,-18868,-19520,-20160,-20788,-21403,-22006,-22595,-23170,-23732,-24279,-24812,-25330,-25833,-26320,-26791,-27246,-27684,-28106,-28511,-28899,-29269,-29622,-29957,-30274,-30572,-30853,-31114,-31357,-31581,-31786,-31972,-32138,-32286,-32413,-32522,-32610,-32679,-32729,-32758};
 
+  static const int16_t ima_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552,
+    1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+  };
+
+  static const int8_t ima_index_table[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+  static uint16_t read_le16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+  }
+
+  static uint32_t read_le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+  }
+
+  // decode the sample at pos, updating the decoder state (pos must be one past the last decoded sample, or a block start)
+  static void adpcm_decode(SampleVoice &voice, uint32_t pos) {
+    auto data = voice.data;
+    uint32_t nibble_index = pos;
+
+    if(voice.block_size) {
+      uint32_t block_samples = (voice.block_size - 4) * 2 + 1;
+      uint32_t block_pos = pos % block_samples;
+      data += (pos / block_samples) * voice.block_size;
+
+      if(block_pos == 0) {
+        // first sample of a block is stored in the header
+        voice.adpcm_predictor = int16_t(read_le16(data));
+        voice.adpcm_index = std::min(data[2], uint8_t(88));
+      } else {
+        data += 4;
+        nibble_index = block_pos - 1;
+      }
+    }
+
+    if(!voice.block_size || nibble_index != pos) {
+      uint8_t nibble = data[nibble_index >> 1];
+      nibble = (nibble_index & 1) ? nibble >> 4 : nibble & 0xF;
+
+      int32_t step = ima_step_table[voice.adpcm_index];
+      int32_t diff = step >> 3;
+      if(nibble & 1) diff += step >> 2;
+      if(nibble & 2) diff += step >> 1;
+      if(nibble & 4) diff += step;
+
+      int32_t predictor = voice.adpcm_predictor + ((nibble & 8) ? -diff : diff);
+      voice.adpcm_predictor = std::max(int32_t(-0x8000), std::min(int32_t(0x7FFF), predictor));
+
+      int index = voice.adpcm_index + ima_index_table[nibble];
+      voice.adpcm_index = std::max(0, std::min(88, index));
+    }
+
+    // save the state at the loop start to go back to when looping
+    if(pos == voice.loop_start) {
+      voice.loop_adpcm_predictor = voice.adpcm_predictor;
+      voice.loop_adpcm_index = voice.adpcm_index;
+    }
+  }
+
+  // move the decoder backwards to pos when looping, from the state saved at the loop start
+  static void adpcm_loop(SampleVoice &voice, uint32_t pos) {
+    // make sure the loop start was decoded, a big enough step can jump over the whole loop
+    for(uint32_t i = voice.position + 1; i <= voice.loop_start; i++)
+      adpcm_decode(voice, i);
+
+    voice.adpcm_predictor = voice.loop_adpcm_predictor;
+    voice.adpcm_index = voice.loop_adpcm_index;
+
+    for(uint32_t i = voice.loop_start + 1; i <= pos; i++)
+      adpcm_decode(voice, i);
+  }
+
+  static int32_t get_sample_voice_frame(AudioChannel &channel) {
+    auto &voice = channel.sample_voice;
+
+    if(voice.position >= voice.length) {
+      channel.off();
+      return 0;
+    }
+
+    int32_t value;
+    switch(voice.format) {
+      case SampleFormat::PCM8:
+        value = (int32_t(voice.data[voice.position]) - 0x80) << 8;
+        break;
+      case SampleFormat::PCM16:
+        value = int16_t(read_le16(voice.data + voice.position * 2));
+        break;
+      default: // IMA_ADPCM
+        value = voice.adpcm_predictor;
+        break;
+    }
+
+    // advance
+    uint32_t fraction = voice.fraction + voice.step;
+    uint32_t new_position = voice.position + (fraction >> 16);
+    voice.fraction = fraction & 0xFFFF;
+
+    if(voice.loop_end && new_position >= voice.loop_end) {
+      new_position = voice.loop_start + (new_position - voice.loop_start) % (voice.loop_end - voice.loop_start);
+
+      if(voice.format == SampleFormat::IMA_ADPCM)
+        adpcm_loop(voice, new_position);
+    } else if(voice.format == SampleFormat::IMA_ADPCM) {
+      for(uint32_t i = voice.position + 1; i <= new_position && i < voice.length; i++)
+        adpcm_decode(voice, i);
+    }
+
+    voice.position = new_position;
+
+    return value;
+  }
+
+  /**
+   * Parse a .wav file in memory. Supports mono 8/16-bit PCM and IMA ADPCM,
+   * loop points are read from the "smpl" chunk if present.
+   *
+   * \param wav Pointer to the file data, which must stay valid while playing
+   * \param wav_len Length of the file data
+   *
+   * \return true if the file was a supported format
+   */
+  bool Sample::parse_wav(const uint8_t *wav, uint32_t wav_len) {
+    if(wav_len < 12 || memcmp(wav, "RIFF", 4) != 0 || memcmp(wav + 8, "WAVE", 4) != 0)
+      return false;
+
+    uint16_t format_tag = 0, channels = 0, bits = 0, block_align = 0;
+    uint32_t fact_length = 0, data_len = 0;
+
+    data = nullptr;
+    loop_start = loop_end = 0;
+
+    uint32_t offset = 12;
+
+    while(offset + 8 <= wav_len) {
+      auto id = wav + offset;
+      auto chunk = id + 8;
+      uint32_t size = std::min(read_le32(id + 4), wav_len - offset - 8);
+
+      if(memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+        format_tag = read_le16(chunk);
+        channels = read_le16(chunk + 2);
+        rate = read_le32(chunk + 4);
+        block_align = read_le16(chunk + 12);
+        bits = read_le16(chunk + 14);
+      } else if(memcmp(id, "fact", 4) == 0 && size >= 4) {
+        fact_length = read_le32(chunk);
+      } else if(memcmp(id, "data", 4) == 0) {
+        data = chunk;
+        data_len = size;
+      } else if(memcmp(id, "smpl", 4) == 0 && size >= 36 + 24 && read_le32(chunk + 28)) {
+        // first loop only, end is inclusive
+        loop_start = read_le32(chunk + 36 + 8);
+        loop_end = read_le32(chunk + 36 + 12) + 1;
+      }
+
+      offset += 8 + size + (size & 1);
+    }
+
+    if(!data || channels != 1)
+      return false;
+
+    if(format_tag == 1 && bits == 8) {
+      format = SampleFormat::PCM8;
+      length = data_len;
+    } else if(format_tag == 1 && bits == 16) {
+      format = SampleFormat::PCM16;
+      length = data_len / 2;
+    } else if(format_tag == 0x11 && bits == 4 && block_align > 4) {
+      format = SampleFormat::IMA_ADPCM;
+      block_size = block_align;
+
+      uint32_t block_samples = (block_align - 4) * 2 + 1;
+      length = (data_len / block_align) * block_samples;
+
+      if(data_len % block_align > 4)
+        length += ((data_len % block_align) - 4) * 2 + 1;
+
+      if(fact_length && fact_length < length)
+        length = fact_length;
+    } else
+      return false;
+
+    if(loop_end > length)
+      loop_end = length;
+
+    if(loop_start >= loop_end)
+      loop_start = loop_end = 0;
+
+    return true;
+  }
+
+  /**
+   * Start playing a sample on this channel. Sets the waveform to SAMPLE and triggers the attack phase.
+   *
+   * \param sample Sample to play
+   */
+  void AudioChannel::play_sample(const Sample &sample) {
+    auto &voice = sample_voice;
+
+    voice.data = sample.data;
+    voice.length = sample.length;
+    voice.loop_start = sample.loop_start;
+    voice.loop_end = sample.loop_end;
+    voice.format = sample.format;
+    voice.block_size = sample.format == SampleFormat::IMA_ADPCM ? sample.block_size : 0;
+
+    voice.position = 0;
+    voice.fraction = 0;
+
+    voice.adpcm_predictor = 0;
+    voice.adpcm_index = 0;
+
+    if(voice.format == SampleFormat::IMA_ADPCM && voice.length)
+      adpcm_decode(voice, 0);
+
+    set_sample_rate(sample.rate);
+
+    waveforms = Waveform::SAMPLE;
+    trigger_attack();
+  }
+
+  /**
+   * Set the playback rate of the current sample, for pitch changes.
+   *
+   * \param rate Rate in Hz, the sample's own rate plays at the original pitch
+   */
+  void AudioChannel::set_sample_rate(uint32_t rate) {
+    sample_voice.step = (uint64_t(rate) << 16) / sample_rate;
+  }
+
   bool is_audio_playing() {
     if(volume == 0) {
       return false;
@@ -128,12 +365,19 @@ namespace blit {
           waveform_count++;
         }
 
+        if(channel.waveforms & Waveform::SAMPLE) {
+          channel_sample += get_sample_voice_frame(channel);
+          waveform_count++;
+        }
+
         if(channel.waveforms & Waveform::WAVE) {
           channel_sample += channel.wave_buffer[channel.wave_buf_pos];
           if (++channel.wave_buf_pos == 64) {
             channel.wave_buf_pos = 0;
-            if(channel.wave_buffer_callback)
-                channel.wave_buffer_callback(channel);
+            if(channel.wave_buffer_callback) {
+              blit_profile_zone("wave_buffer_callback");
+              channel.wave_buffer_callback(channel);
+            }
           }
           waveform_count++;
         }
@@ -50,9 +50,55 @@ namespace blit {
     SAW       = 32,
     TRIANGLE  = 16,
     SINE      = 8,
+    SAMPLE    = 2,  // sample playback (see AudioChannel::play_sample), can't be combined with WAVE
     WAVE      = 1
   };
 
+  enum class SampleFormat : uint8_t {
+    PCM8,       // unsigned 8-bit (as in .wav files)
+    PCM16,      // signed 16-bit little-endian
+    IMA_ADPCM   // 4-bit IMA ADPCM, low nibble first
+  };
+
+  // Sample data for playback directly from flash/memory (for example, a File::get_ptr() or an asset)
+  // The data is not copied so must stay valid while playing.
+  struct Sample {
+    const uint8_t *data = nullptr;
+    uint32_t length = 0;                  // length in samples
+    uint32_t rate = sample_rate;          // sample rate the data was recorded at (Hz)
+    SampleFormat format = SampleFormat::PCM16;
+    uint16_t block_size = 0;              // IMA ADPCM block size (with 4 byte header), 0 for a headerless stream
+
+    uint32_t loop_start = 0;              // loop region in samples, no loop if loop_end is 0
+    uint32_t loop_end = 0;
+
+    Sample() = default;
+    Sample(const uint8_t *data, uint32_t length, SampleFormat format, uint32_t rate = sample_rate)
+      : data(data), length(length), rate(rate), format(format) {}
+
+    bool parse_wav(const uint8_t *wav, uint32_t wav_len);
+  };
+
+  // playback state for the SAMPLE waveform
+  // (packed so that sharing memory with AudioChannel::wave_buffer doesn't change its offset)
+  #pragma pack(push, 2)
+  struct SampleVoice {
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t loop_start, loop_end;
+
+    uint32_t position;                    // current sample
+    uint32_t step;                        // Q16 samples to advance per output sample
+    uint16_t fraction;                    // Q16 fractional part of position
+    uint16_t block_size;
+    SampleFormat format;
+
+    // IMA ADPCM decoder state
+    uint8_t adpcm_index, loop_adpcm_index;
+    int16_t adpcm_predictor, loop_adpcm_predictor;
+  };
+  #pragma pack(pop)
+
   enum class ADSRPhase : uint8_t {
     ATTACK,
     DECAY,
@@ -86,7 +132,10 @@ namespace blit {
       ADSRPhase adsr_phase    = ADSRPhase::OFF;
 
       uint8_t   wave_buf_pos  = 0;      //
-      int16_t   wave_buffer[64];        // buffer for arbitrary waveforms. small as it's filled by user callback
+      union {
+        int16_t   wave_buffer[64];      // buffer for arbitrary waveforms. small as it's filled by user callback
+        SampleVoice sample_voice;       // sample playback state (shares memory with wave_buffer to keep the size the same)
+      };
 
       void *user_data = nullptr;
       void (*wave_buffer_callback)(AudioChannel &channel);
@@ -125,6 +174,9 @@ namespace blit {
 		    adsr_phase = ADSRPhase::OFF;
 		    adsr_step = 0;
 	    }
+
+      void play_sample(const Sample &sample);
+      void set_sample_rate(uint32_t rate);
   };
 
   extern AudioChannel *&channels;
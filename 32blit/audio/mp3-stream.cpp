@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <cinttypes>
 #include <cstring>
+#include <memory>
 
 #include "mp3-stream.hpp"
 
@@ -49,11 +51,15 @@ namespace blit {
     if(!file_buffer_filled)
       return false;
 
-    if(do_duration_calc) {
-      mp3dec_init(static_cast<mp3dec_t *>(mp3dec));
-      duration_ms = calc_duration();
-    } else
-      duration_ms = 0;
+    frame_index.clear();
+    num_frames = 0;
+
+    // a Xing/VBRI header gives us the duration without reading the whole file
+    mp3dec_init(static_cast<mp3dec_t *>(mp3dec));
+    duration_ms = parse_vbr_header();
+
+    if(!duration_ms && do_duration_calc && build_index())
+      duration_ms = (static_cast<uint64_t>(num_frames) * frame_samples * 1000) / source_rate;
 
     // start the decoder
     mp3dec_init(static_cast<mp3dec_t *>(mp3dec));
@@ -101,9 +107,7 @@ namespace blit {
     pause();
 
     // reset file buffer
-    file_buffer_filled = 0;
-    file_offset = 0;
-    read(0);
+    seek_file(0);
 
     // reset sample buffer
     current_sample = nullptr;
@@ -116,6 +120,95 @@ namespace blit {
       play(channel, play_flags);
   }
 
+  /**
+   * Seek to a sample. Uses the frame index, which is built on the first seek
+   * if it wasn't already built by `load`. Building it reads the whole file, so
+   * the first seek can take a while (especially from the SD card). Calling
+   * `load` with `do_duration_calc` builds it up front for files without a
+   * Xing/VBRI header. Playback is unaffected if this fails.
+   *
+   * \param sample Output sample (at 22050Hz) to continue playback from
+   *
+   * \return true if the sample is within the stream
+   */
+  bool MP3Stream::seek(unsigned int sample) {
+    if(!file.is_open())
+      return false;
+
+    if(frame_index.empty() && !build_index())
+      return false;
+
+    // samples per frame after conversion to 22050Hz
+    unsigned int freq_scale = std::max(1u, source_rate / sample_rate);
+    unsigned int out_frame_samples = frame_samples / freq_scale;
+
+    unsigned int target_frame = sample / out_frame_samples;
+    if(target_frame >= num_frames)
+      return false;
+
+    bool was_playing = get_playing();
+    pause();
+
+    auto dec = static_cast<mp3dec_t *>(mp3dec);
+
+    // start a few frames early as the target may use data from previous frames
+    unsigned int start_frame = target_frame > seek_preroll_frames ? target_frame - seek_preroll_frames : 0;
+    unsigned int frame = start_frame - start_frame % index_interval;
+
+    seek_file(frame_index[frame / index_interval]);
+    mp3dec_init(dec);
+
+    // skip headers up to the pre-roll, then decode (and discard) the pre-roll frames
+    int16_t tmp_buf[MINIMP3_MAX_SAMPLES_PER_FRAME];
+    mp3dec_frame_info_t info = {};
+
+    while(frame < target_frame && file_buffer_filled) {
+      if(mp3dec_decode_frame(dec, file_buffer, file_buffer_filled, nullptr, &info)) {
+        if(frame >= start_frame)
+          mp3dec_decode_frame(dec, file_buffer, file_buffer_filled, tmp_buf, &info);
+        frame++;
+      }
+
+      if(!info.frame_bytes)
+        break;
+
+      read(info.frame_bytes);
+    }
+
+    // setup conversion here so that decode doesn't decode the first frame twice
+    if(mp3dec_decode_frame(dec, file_buffer, file_buffer_filled, nullptr, &info))
+      need_convert = info.channels != 1 || info.hz != sample_rate;
+
+    // refill sample buffers and skip to the sample within the frame
+    data_size[0] = data_size[1] = 0;
+    decode(0);
+    decode(1);
+
+    unsigned int frame_offset = sample % out_frame_samples;
+
+    if(data_size[0] <= int(frame_offset)) {
+      current_sample = nullptr;
+      return false;
+    }
+
+    cur_audio_buf = 0;
+    current_sample = audio_buf[0] + frame_offset;
+    end_sample = audio_buf[0] + data_size[0];
+
+    if(channel != -1) {
+      // replace the old samples in the channel buffer
+      callback(blit::channels[channel]);
+      blit::channels[channel].wave_buf_pos = 0;
+    }
+
+    buffered_samples = sample;
+
+    if(was_playing)
+      play(channel, play_flags & ~PlayFlags::from_start);
+
+    return true;
+  }
+
   bool MP3Stream::get_playing() const {
     return channel != -1 && blit::channels[channel].adsr_phase == blit::ADSRPhase::SUSTAIN;
   }
@@ -196,9 +289,7 @@ namespace blit {
     if(!samples) {
       if(play_flags & PlayFlags::loop) {
         // back to start
-        file_buffer_filled = 0;
-        file_offset = 0;
-        read(0);
+        seek_file(0);
 
         mp3dec_init(static_cast<mp3dec_t *>(mp3dec));
         decode(buf_index);
@@ -237,48 +328,114 @@ namespace blit {
 
     auto out = channel.wave_buffer;
 
+    // buffers may not end on a multiple of 64 after seeking
     int i = 0;
-    for(; i < 64; i++)
-      *(out++) = *(current_sample++);
+    while(i < 64) {
+      int count = std::min(64 - i, int(end_sample - current_sample));
+      memcpy(out + i, current_sample, count * sizeof(int16_t));
+      current_sample += count;
+      i += count;
 
+      if(current_sample != end_sample)
+        break;
 
-    // swap buffers
-    if(current_sample == end_sample) {
+      // swap buffers
       data_size[cur_audio_buf] = 0;
       cur_audio_buf++;
       cur_audio_buf %= 2;
 
-      if(data_size[cur_audio_buf] == -1) // EOF
+      if(data_size[cur_audio_buf] == -1) { // EOF
         current_sample = end_sample = nullptr;
-      else {
-        current_sample = audio_buf[cur_audio_buf];
-        end_sample = current_sample + data_size[cur_audio_buf];
-        // if(current_sample == end_sample) underrun
+        break;
       }
+
+      current_sample = audio_buf[cur_audio_buf];
+      end_sample = current_sample + data_size[cur_audio_buf];
+
+      if(current_sample == end_sample) // underrun
+        break;
     }
 
+    if(i < 64)
+      memset(out + i, 0, (64 - i) * sizeof(int16_t));
+
     buffered_samples += 64;
   }
 
-  int MP3Stream::calc_duration() {
-    // decode entire file to get length
-    unsigned int samples = 0;
+  int MP3Stream::parse_vbr_header() {
+    mp3dec_frame_info_t info = {};
+
+    if(!mp3dec_decode_frame(static_cast<mp3dec_t *>(mp3dec), file_buffer, file_buffer_filled, nullptr, &info))
+      return 0;
+
+    auto hdr = file_buffer + info.frame_offset;
+    int frame_len = info.frame_bytes - info.frame_offset;
 
+    frame_samples = hdr_frame_samples(hdr);
+    source_rate = info.hz;
+
+    auto read_be32 = [](const uint8_t *p) {
+      return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+    };
+
+    uint32_t frames = 0;
+
+    // Xing/Info tag follows the side info
+    int side_info_len = HDR_TEST_MPEG1(hdr) ? (HDR_IS_MONO(hdr) ? 17 : 32) : (HDR_IS_MONO(hdr) ? 9 : 17);
+    auto tag = hdr + HDR_SIZE + side_info_len;
+
+    if(HDR_SIZE + side_info_len + 12 <= frame_len && (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0)) {
+      if(read_be32(tag + 4) & 1) // has frame count
+        frames = read_be32(tag + 8);
+    } else if(HDR_SIZE + 32 + 18 <= frame_len && memcmp(hdr + HDR_SIZE + 32, "VBRI", 4) == 0) {
+      // VBRI is always at the same offset
+      frames = read_be32(hdr + HDR_SIZE + 32 + 14);
+    }
+
+    return (static_cast<uint64_t>(frames) * frame_samples * 1000) / source_rate;
+  }
+
+  bool MP3Stream::build_index() {
+    // walk the frame headers (without decoding) and record the offset of every index_interval-th frame
+    auto dec = static_cast<mp3dec_t *>(mp3dec);
     mp3dec_frame_info_t info = {};
 
-    //while(true)
+    frame_index.clear();
+    num_frames = 0;
+
+    // this may be called during playback, so put the file and decoder back where they were afterwards
+    auto saved_offset = get_buffer_offset();
+    // (the decoder state is several KB, so keep the copy off the stack)
+    std::unique_ptr<mp3dec_t> saved_dec(new mp3dec_t(*dec));
+
+    seek_file(0);
+    mp3dec_init(dec);
+
     while(file_buffer_filled) {
-      samples += mp3dec_decode_frame(static_cast<mp3dec_t *>(mp3dec), file_buffer, file_buffer_filled, nullptr, &info);
+      int samples = mp3dec_decode_frame(dec, file_buffer, file_buffer_filled, nullptr, &info);
+
+      if(samples) {
+        if(num_frames % index_interval == 0)
+          frame_index.push_back(get_buffer_offset() + info.frame_offset);
+
+        if(!num_frames) {
+          frame_samples = samples;
+          source_rate = info.hz;
+        }
+
+        num_frames++;
+      }
+
+      if(!info.frame_bytes)
+        break;
+
       read(info.frame_bytes);
     }
 
-    // reset;
-    file_offset = 0;
-    file_buffer_filled = 0;
-    read(0);
+    seek_file(saved_offset);
+    *dec = *saved_dec;
 
-    int len_ms = (static_cast<uint64_t>(samples) * 1000) / info.hz;
-    return len_ms;
+    return num_frames != 0;
   }
 
   void MP3Stream::read(int32_t len) {
@@ -313,4 +470,25 @@ namespace blit {
     file_buffer_filled += read;
     file_offset += read;
   }
+
+  void MP3Stream::seek_file(uint32_t offset) {
+    file_buffer_filled = 0;
+
+    if(file.get_ptr()) {
+      // reset to the start of the buffer, then skip
+      read(0);
+      read(offset);
+    } else {
+      file_offset = offset;
+      read(0);
+    }
+  }
+
+  // file offset of the start of file_buffer
+  uint32_t MP3Stream::get_buffer_offset() const {
+    if(file.get_ptr())
+      return file_buffer - file.get_ptr();
+
+    return file_offset - file_buffer_filled;
+  }
 }
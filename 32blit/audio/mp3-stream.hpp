@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "audio/audio.hpp"
 #include "engine/file.hpp"
@@ -23,6 +24,7 @@ namespace blit {
     void play(int channel, int flags = 0);
     void pause();
     void restart();
+    bool seek(unsigned int sample); // the first seek reads the whole file to index it unless load already did
 
     bool get_playing() const;
     int get_play_flags() const;
@@ -34,9 +36,12 @@ namespace blit {
 
   private:
     void decode(int buf_index);
-    int calc_duration();
+    int parse_vbr_header();
+    bool build_index();
 
     void read(int32_t len);
+    void seek_file(uint32_t offset);
+    uint32_t get_buffer_offset() const;
 
     static void static_callback(AudioChannel &channel);
     void callback(AudioChannel &channel);
@@ -64,5 +69,14 @@ namespace blit {
 
     unsigned int buffered_samples = 0;
     int duration_ms = 0;
+
+    // seeking
+    static const unsigned int index_interval = 16; // frames between index entries
+    static const unsigned int seek_preroll_frames = 8; // frames decoded before a seek target to refill the bit reservoir
+
+    std::vector<uint32_t> frame_index; // file offset of every index_interval-th frame
+    unsigned int num_frames = 0;
+    unsigned int frame_samples = 0; // per frame, at the source rate
+    unsigned int source_rate = 0;
   };
 }
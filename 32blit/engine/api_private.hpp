@@ -5,6 +5,7 @@
 
 #include "engine.hpp"
 #include "file.hpp"
+#include "frame_stats.hpp"
 #include "../audio/audio.hpp"
 #include "../engine/input.hpp"
 #include "../engine/version.hpp"
@@ -17,7 +18,7 @@ namespace blit {
 
   using AllocateCallback = uint8_t *(*)(size_t);
 
-  constexpr uint16_t api_version_major = 0, api_version_minor = 2;
+  constexpr uint16_t api_version_major = 0, api_version_minor = 3;
 
   // template for screen modes
   struct SurfaceTemplate {
@@ -135,6 +136,9 @@ namespace blit {
 
     // another launcher API
     void (*list_installed_games)(std::function<void(const uint8_t *, uint32_t, uint32_t)> callback);
+
+    // shared frame statistics, owned by the firmware
+    FrameStats *frame_stats;
   };
   #pragma pack(pop)
 
@@ -4,6 +4,8 @@
 
 #include "engine.hpp"
 #include "api_private.hpp"
+#include "frame_stats.hpp"
+#include "profile_zone.hpp"
 #include "timer.hpp"
 #include "tweening.hpp"
 
@@ -91,13 +93,13 @@ namespace blit {
   Surface null_surface(nullptr, PixelFormat::M, Size(0, 0));
   Surface &screen = null_surface;
 
-  static const uint32_t update_rate_ms = 10;
+  static uint32_t update_rate_ms = 10;
+  static uint32_t max_catch_up_updates = 0; // 0 = unlimited
   static uint32_t pending_update_time = 0;
 
   static uint32_t last_tick_time = 0;
   static uint32_t last_state = 0;
 
-  extern std::vector<Timer *> timers;
   extern std::vector<Tween *> tweens;
 
   int tick(uint32_t time) {
@@ -110,10 +112,7 @@ namespace blit {
       auto skipped_time = time - last_tick_time;
       last_tick_time = time;
 
-      for (auto &timer : timers) {
-        timer->started += skipped_time;
-        timer->paused += skipped_time;
-      }
+      shift_timers(skipped_time);
 
       for (auto &tween : tweens) {
         tween->started += skipped_time;
@@ -129,6 +128,15 @@ namespace blit {
 
     // catch up on updates if any pending
     pending_update_time += (time - last_tick_time);
+
+    // too far behind, drop whole updates so the game slows down instead of spending all its time catching up
+    uint32_t dropped_updates = 0;
+    if (max_catch_up_updates && pending_update_time >= update_rate_ms * (max_catch_up_updates + 1)) {
+      dropped_updates = pending_update_time / update_rate_ms - max_catch_up_updates;
+      pending_update_time = update_rate_ms * max_catch_up_updates + pending_update_time % update_rate_ms;
+    }
+
+    uint32_t updates = 0;
     while (pending_update_time >= update_rate_ms) {
       // button state changes
       uint32_t changed = api.buttons.state ^ last_state;
@@ -139,13 +147,59 @@ namespace blit {
 
       update(time - pending_update_time); // create fake timestamp that would have been accurate for the update event
       pending_update_time -= update_rate_ms;
+      updates++;
     }
 
+    frame_stats_tick(updates, dropped_updates);
+
     last_tick_time = time;
 
+#ifdef BLIT_PROFILE_ZONES
+    profile_zones_end_frame();
+#endif
+
     return update_rate_ms - pending_update_time;
   }
 
+  /**
+   * Set the time between calls to `update`. Defaults to 10ms.
+   *
+   * \param rate_ms Update period in milliseconds
+   */
+  void set_update_rate(uint32_t rate_ms) {
+    if (rate_ms)
+      update_rate_ms = rate_ms;
+  }
+
+  uint32_t get_update_rate() {
+    return update_rate_ms;
+  }
+
+  /**
+   * Limit the number of updates a single tick can run to catch up. Any time past the limit is dropped, which slows
+   * the game down instead of stalling it on slow frames.
+   *
+   * \param max_updates Maximum updates per tick, 0 for no limit (the default)
+   */
+  void set_max_catch_up_updates(uint32_t max_updates) {
+    max_catch_up_updates = max_updates;
+  }
+
+  /**
+   * Get how far the current time is between the last update and the next one, for interpolating positions in `render`
+   * when it runs more often than `update`.
+   *
+   * \return 0 at the last update, up to 1 when the next update is due
+   */
+  float get_update_alpha() {
+    auto pending = pending_update_time + (now() - last_tick_time);
+
+    if (pending >= update_rate_ms)
+      return 1.0f;
+
+    return float(pending) / update_rate_ms;
+  }
+
   const char *get_launch_path() {
     return api.get_launch_path();
   }
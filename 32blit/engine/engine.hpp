@@ -30,5 +30,10 @@ namespace blit {
 
   int tick(uint32_t time);
 
+  void set_update_rate(uint32_t rate_ms);
+  uint32_t get_update_rate();
+  void set_max_catch_up_updates(uint32_t max_updates);
+  float get_update_alpha();
+
   const char *get_launch_path();
 }
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#include "frame_stats.hpp"
+#include "api_private.hpp"
+#include "engine.hpp"
+#include "../graphics/font.hpp"
+#include "../graphics/surface.hpp"
+
+namespace blit {
+
+  // render time that fills the graph, one frame at 50Hz
+  static const uint32_t render_budget_us = 20000;
+
+  static FrameStats local_frame_stats;
+
+  // the firmware provides shared stats on the device
+  static FrameStats &stats() {
+    return api.frame_stats ? *api.frame_stats : local_frame_stats;
+  }
+
+  void FrameStatHistogram::reset(uint32_t bucket_width) {
+    this->bucket_width = bucket_width;
+
+    for(auto &bucket : buckets)
+      bucket = 0;
+
+    for(auto &value : history)
+      value = 0;
+
+    history_pos = 0;
+    count = 0;
+    min = max = 0;
+    total = 0;
+  }
+
+  void FrameStatHistogram::add(uint32_t value) {
+    auto bucket = value / bucket_width;
+    if(bucket >= num_buckets)
+      bucket = num_buckets - 1;
+
+    buckets[bucket]++;
+
+    history[history_pos] = value;
+    history_pos = (history_pos + 1) % history_size;
+
+    if(count == 0 || value < min)
+      min = value;
+    if(value > max)
+      max = value;
+
+    count++;
+    total += value;
+  }
+
+  /**
+   * \return The most recently added value
+   */
+  uint32_t FrameStatHistogram::last() const {
+    return history[(history_pos + history_size - 1) % history_size];
+  }
+
+  uint32_t FrameStatHistogram::average() const {
+    return count ? uint32_t(total / count) : 0;
+  }
+
+  /**
+   * Estimate a percentile from the buckets
+   *
+   * \param percent Percentile to find (0-100)
+   * \return Upper bound of the bucket containing the percentile, limited to the maximum
+   */
+  uint32_t FrameStatHistogram::percentile(int percent) const {
+    if(!count)
+      return 0;
+
+    uint64_t target = (uint64_t(count) * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for(int i = 0; i < num_buckets - 1; i++) {
+      seen += buckets[i];
+      if(seen >= target)
+        return std::min((i + 1) * bucket_width, max);
+    }
+
+    return max;
+  }
+
+  FrameStats::FrameStats() {
+    reset();
+  }
+
+  void FrameStats::reset() {
+    updates.reset(1);
+    render_us.reset(2000);
+    frame_us.reset(2000);
+    audio_us.reset(100);
+
+    ticks = 0;
+    dropped_frames = 0;
+
+    last_render_end_us = 0;
+  }
+
+  const FrameStats &get_frame_stats() {
+    return stats();
+  }
+
+  void reset_frame_stats() {
+    stats().reset();
+  }
+
+  void frame_stats_render(uint32_t us) {
+    auto &s = stats();
+
+    auto end_us = now_us();
+
+    if(s.render_us.count)
+      s.frame_us.add(us_diff(s.last_render_end_us, end_us));
+
+    s.render_us.add(us);
+    s.last_render_end_us = end_us;
+  }
+
+  void frame_stats_audio(uint32_t us) {
+    stats().audio_us.add(us);
+  }
+
+  void frame_stats_tick(uint32_t updates, uint32_t dropped_updates) {
+    auto &s = stats();
+
+    s.updates.add(updates);
+    s.ticks++;
+    s.dropped_frames += dropped_updates;
+  }
+
+  void draw_frame_stats(Surface &dest, Point pos) {
+    const int bar_width = 2, line_height = 9, graph_height = 24, border = 2;
+    const int width = border * 2 + bar_width * FrameStatHistogram::history_size;
+    const int height = border * 2 + line_height * 4 + graph_height;
+
+    auto &s = stats();
+    char buf[40];
+
+    dest.pen = Pen(0, 0, 0, 200);
+    dest.rectangle(Rect(pos, Size(width, height)));
+
+    dest.pen = Pen(255, 255, 255);
+
+    auto text_pos = pos + Point(border, border);
+    snprintf(buf, sizeof(buf), "upd %" PRIu32 "/%" PRIu32 " drop %" PRIu32, s.updates.last(), s.updates.max, s.dropped_frames);
+    dest.text(buf, minimal_font, text_pos);
+
+    text_pos.y += line_height;
+    snprintf(buf, sizeof(buf), "rnd %" PRIu32 " p95 %" PRIu32 "us", s.render_us.average(), s.render_us.percentile(95));
+    dest.text(buf, minimal_font, text_pos);
+
+    text_pos.y += line_height;
+    snprintf(buf, sizeof(buf), "frm %" PRIu32 " p95 %" PRIu32 "us", s.frame_us.average(), s.frame_us.percentile(95));
+    dest.text(buf, minimal_font, text_pos);
+
+    text_pos.y += line_height;
+    snprintf(buf, sizeof(buf), "aud %" PRIu32 " p95 %" PRIu32 "us", s.audio_us.average(), s.audio_us.percentile(95));
+    dest.text(buf, minimal_font, text_pos);
+
+    // render time graph, oldest on the left
+    const int graph_bottom = pos.y + height - border;
+
+    for(int i = 0; i < FrameStatHistogram::history_size; i++) {
+      auto value = s.render_us.history[(s.render_us.history_pos + i) % FrameStatHistogram::history_size];
+      int bar_height = value >= render_budget_us ? graph_height : value * graph_height / render_budget_us;
+
+      if(!bar_height)
+        continue;
+
+      dest.pen = value >= render_budget_us ? Pen(255, 0, 0) : Pen(0, 255, 0);
+      dest.rectangle(Rect(pos.x + border + i * bar_width, graph_bottom - bar_height, bar_width, bar_height));
+    }
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// Frame statistics
+//
+// The engine keeps histograms of how much work each frame took so the same performance view is available on every
+// port. tick() records the number of update() calls it made, while the platform records how long render() took and
+// how long each audio mix took. The time between renders is also recorded, to show how steady the frame rate is.
+// Updates skipped because of the catch-up limit (see set_max_catch_up_updates) count as dropped frames. Without a
+// limit nothing is skipped, a slow frame shows up as a tick with more updates instead.
+//
+// void render(uint32_t time) {
+//   ...
+//   blit::draw_frame_stats(blit::screen, blit::Point(0, 0));
+// }
+//
+// On the device the stats are owned by the firmware and shared through the API, so they also include time spent in the
+// system menu.
+
+#include <cstdint>
+
+#include "../types/point.hpp"
+
+namespace blit {
+  struct Surface;
+
+  struct FrameStatHistogram {
+    static constexpr int num_buckets = 16;
+    static constexpr int history_size = 64;
+
+    uint32_t bucket_width; // the last bucket also counts anything larger
+    uint32_t buckets[num_buckets];
+
+    uint32_t history[history_size]; // most recent values, for graphs
+    uint32_t history_pos;
+
+    uint32_t count;
+    uint32_t min, max;
+    uint64_t total;
+
+    void reset(uint32_t bucket_width);
+    void add(uint32_t value);
+
+    uint32_t last() const;
+    uint32_t average() const;
+    uint32_t percentile(int percent) const;
+  };
+
+  struct FrameStats {
+    FrameStatHistogram updates;   // update() calls per tick
+    FrameStatHistogram render_us; // time spent in render()
+    FrameStatHistogram frame_us;  // time between renders
+    FrameStatHistogram audio_us;  // time spent mixing each block of audio
+
+    uint32_t ticks;
+    uint32_t dropped_frames; // updates skipped by the catch-up limit
+
+    uint32_t last_render_end_us;
+
+    FrameStats();
+
+    void reset();
+  };
+
+  /**
+   * Get the statistics of recent frames
+   */
+  const FrameStats &get_frame_stats();
+
+  /**
+   * Reset all frame statistics
+   */
+  void reset_frame_stats();
+
+  /**
+   * Record the time taken by a render. Called by the platform.
+   *
+   * \param us Time spent in `render()` in microseconds
+   */
+  void frame_stats_render(uint32_t us);
+
+  /**
+   * Record the time taken to mix a block of audio. Called by the platform, from the thread that calls `tick()` as the
+   * stats aren't synchronised.
+   *
+   * \param us Time spent in `get_audio_frame()` in microseconds
+   */
+  void frame_stats_audio(uint32_t us);
+
+  // called by tick()
+  void frame_stats_tick(uint32_t updates, uint32_t dropped_updates);
+
+  /**
+   * Draw the frame statistics overlay
+   *
+   * \param dest Surface to draw to
+   * \param pos Top-left of the overlay
+   */
+  void draw_frame_stats(Surface &dest, Point pos);
+}
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "engine/api.hpp"
 #include "engine/engine.hpp"
 #include "graphics/surface.hpp"
+#include "graphics/text_layout.hpp"
 
 namespace blit {
 
@@ -22,7 +24,7 @@ namespace blit {
     };
 
     Menu(std::string_view title, const Item *items = nullptr, int num_items = 0, const Font &font = minimal_font)
-      : title(title), items(items), num_items(num_items), display_rect(0, 0, 0, 0), font(font) {}
+      : title(title), items(items), num_items(num_items), display_rect(0, 0, 0, 0), font(font), title_layout(font, true, TextAlign::center_left) {}
 
     virtual ~Menu() = default;
 
@@ -154,7 +156,15 @@ public:
       item_rect.x += item_padding_x;
       item_rect.y += item_adjust_y;
       item_rect.h += font.spacing_y; // adjust for alignment
-      screen.text(item.label, font, item_rect, true, TextAlign::center_left);
+
+      // labels are only laid out again if they change
+      if(item_layouts.size() != size_t(num_items))
+        item_layouts.assign(num_items, TextLayout(font, true, TextAlign::center_left));
+
+      auto &layout = item_layouts[index];
+      layout.set_text(item.label);
+      layout.set_size(item_rect.size());
+      layout.draw(screen, Point(item_rect.x, item_rect.y));
     }
 
     //
@@ -186,7 +196,10 @@ public:
       screen.pen = header_foreground;
       header_rect.x += item_padding_x;
       header_rect.h += font.spacing_y; // adjust for alignment
-      screen.text(title, font, header_rect, true, TextAlign::center_left);
+
+      title_layout.set_text(title);
+      title_layout.set_size(header_rect.size());
+      title_layout.draw(screen, Point(header_rect.x, header_rect.y));
     }
 
     //
@@ -218,6 +231,9 @@ public:
 
     const Font &font;
 
+    TextLayout title_layout;
+    mutable std::vector<TextLayout> item_layouts;
+
     // colours
     Pen background_colour = Pen(30,  30,  50, 200);
     Pen foreground_colour = Pen(255, 255, 255);
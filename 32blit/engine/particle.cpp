@@ -1,8 +1,11 @@
 /*! \file particle.cpp
     \brief Particle system
 */
+#include <algorithm>
+
 #include "particle.hpp"
 #include "engine.hpp"
+#include "../graphics/surface.hpp"
 
 namespace blit {
 
@@ -28,7 +31,11 @@ namespace blit {
    * \param time_ms Particle system age, in milliseconds.
    */
   void ParticleGenerator::update(uint32_t time_ms) {
-    static uint32_t last_time_ms = time_ms;
+    if(!started) {
+      last_time_ms = time_ms;
+      started = true;
+    }
+
     uint32_t elapsed_ms = time_ms - last_time_ms;
 
     // delete expired particles
@@ -58,4 +65,157 @@ namespace blit {
 
     last_time_ms = time_ms;
   }
-}
\ No newline at end of file
+
+  /**
+   * Create a new pooled particle system.
+   *
+   * All storage is allocated here, emitting and expiring particles does not allocate.
+   *
+   * \param capacity Maximum number of live particles.
+   * \param lifetime_ms Particle lifetime in milliseconds.
+   * \param generate Optional callback to initialise particles spawned by `update`.
+   * \param spawn_rate Number of particles to spawn per second with `generate`.
+   */
+  ParticleSystem::ParticleSystem(uint32_t capacity, uint32_t lifetime_ms, GenerateCallback generate, uint32_t spawn_rate)
+    : capacity(capacity), lifetime_ms(lifetime_ms), spawn_rate(spawn_rate), generate(generate),
+      pos_x(capacity), pos_y(capacity), vel_x(capacity), vel_y(capacity), user(capacity), age_ms(capacity) {
+  }
+
+  /**
+   * Add a particle to the system.
+   *
+   * \param pos Initial position.
+   * \param vel Initial velocity, in units/s.
+   * \param user Per-particle value for the game.
+   * \return `false` if the system is full.
+   */
+  bool ParticleSystem::emit(const Vec2 &pos, const Vec2 &vel, float user) {
+    if(live_count == capacity)
+      return false;
+
+    auto i = live_count++;
+    pos_x[i] = pos.x;
+    pos_y[i] = pos.y;
+    vel_x[i] = vel.x;
+    vel_y[i] = vel.y;
+    this->user[i] = user;
+    age_ms[i] = 0;
+
+    return true;
+  }
+
+  /**
+   * Remove a particle by moving the last particle into its place.
+   *
+   * This changes the particle at index `i`, so when removing while iterating go from the end.
+   *
+   * \param i Index of the particle to remove.
+   */
+  void ParticleSystem::remove(uint32_t i) {
+    auto last = --live_count;
+    pos_x[i] = pos_x[last];
+    pos_y[i] = pos_y[last];
+    vel_x[i] = vel_x[last];
+    vel_y[i] = vel_y[last];
+    user[i] = user[last];
+    age_ms[i] = age_ms[last];
+  }
+
+  /**
+   * Remove all particles.
+   */
+  void ParticleSystem::clear() {
+    live_count = 0;
+  }
+
+  /**
+   * Update state of the particle system.
+   *
+   * Ages and removes expired particles, applies `force` and velocities then spawns
+   * new particles at `spawn_rate`.
+   *
+   * \param time_ms Current time, in milliseconds.
+   */
+  void ParticleSystem::update(uint32_t time_ms) {
+    if(!started) {
+      last_time_ms = time_ms;
+      started = true;
+    }
+
+    uint32_t elapsed_ms = time_ms - last_time_ms;
+    last_time_ms = time_ms;
+
+    // age and expire
+    for(uint32_t i = 0; i < live_count;) {
+      age_ms[i] += elapsed_ms;
+
+      if(age_ms[i] > lifetime_ms)
+        remove(i); // re-check the particle moved into this slot
+      else
+        i++;
+    }
+
+    // integrate, kept separate from the above so that it's a simple loop over the arrays
+    float td = elapsed_ms / 1000.0f;
+    float fx = force.x * td, fy = force.y * td;
+
+    float *px = pos_x.data(), *py = pos_y.data();
+    float *vx = vel_x.data(), *vy = vel_y.data();
+
+    for(uint32_t i = 0; i < live_count; i++) {
+      vx[i] += fx;
+      vy[i] += fy;
+      px[i] += vx[i] * td;
+      py[i] += vy[i] * td;
+    }
+
+    // spawn new particles
+    if(generate && spawn_rate) {
+      spawn_remainder += elapsed_ms * spawn_rate;
+      uint32_t spawn_count = spawn_remainder / 1000;
+      spawn_remainder %= 1000;
+
+      for(; spawn_count && live_count < capacity; spawn_count--) {
+        auto i = live_count++;
+        Vec2 pos, vel;
+        user[i] = 0.0f;
+        generate(pos, vel, user[i]);
+
+        pos_x[i] = pos.x;
+        pos_y[i] = pos.y;
+        vel_x[i] = vel.x;
+        vel_y[i] = vel.y;
+        age_ms[i] = 0;
+      }
+    }
+  }
+
+  /**
+   * Draw all particles as single pixels, coloured by age.
+   *
+   * The colour is picked from `ramp` by age, with the first entry used for new particles
+   * and the last for particles about to expire.
+   *
+   * \param dest Surface to draw to.
+   * \param offset Offset added to particle positions.
+   * \param ramp Array of pens to use.
+   * \param ramp_size Number of entries in `ramp`.
+   */
+  void ParticleSystem::render(Surface &dest, const Point &offset, const Pen *ramp, uint32_t ramp_size) {
+    if(!ramp_size)
+      return;
+
+    auto &clip = dest.clip;
+
+    for(uint32_t i = 0; i < live_count; i++) {
+      int32_t x = int32_t(pos_x[i]) + offset.x;
+      int32_t y = int32_t(pos_y[i]) + offset.y;
+
+      if(x < clip.x || y < clip.y || x >= clip.x + clip.w || y >= clip.y + clip.h)
+        continue;
+
+      uint32_t ramp_index = std::min(uint64_t(age_ms[i]) * ramp_size / (lifetime_ms + 1), uint64_t(ramp_size - 1));
+      dest.pbf(&ramp[ramp_index], &dest, dest.offset(x, y), 1);
+    }
+  }
+}
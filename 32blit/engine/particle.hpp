@@ -3,9 +3,14 @@
 #include <queue>
 #include <functional>
 #include <cstdint>
+#include <vector>
 #include "../types/vec2.hpp"
+#include "../types/point.hpp"
 
 namespace blit {
+  struct Pen;
+  struct Surface;
+
   struct Particle {
     blit::Vec2 pos;
     blit::Vec2 vel;
@@ -31,5 +36,57 @@ namespace blit {
     ~ParticleGenerator();
 
     void update(uint32_t time_ms);
+
+  private:
+    uint32_t last_time_ms = 0;
+    bool started = false;
+  };
+
+  /**
+   * Pooled particle system.
+   *
+   * Particle state is stored as separate arrays (structure of arrays) allocated once
+   * at construction. Live particles are always packed into indices [0, size()), expired
+   * particles are replaced by the last live particle.
+   */
+  struct ParticleSystem {
+    using GenerateCallback = std::function<void(Vec2 &pos, Vec2 &vel, float &user)>;
+
+    const uint32_t capacity;                // the particle arrays are allocated with this size
+    uint32_t lifetime_ms;
+    uint32_t spawn_rate;                    // particles generated per second by update
+    blit::Vec2 force;                       // acceleration applied to all particles, in units/s^2
+
+    GenerateCallback generate;
+
+    // particle data, only the first size() entries are valid
+    std::vector<float> pos_x, pos_y;
+    std::vector<float> vel_x, vel_y;
+    std::vector<float> user;                // per-particle value for the game (e.g. a random variation)
+    std::vector<uint32_t> age_ms;
+
+    ParticleSystem(uint32_t capacity, uint32_t lifetime_ms, GenerateCallback generate = nullptr, uint32_t spawn_rate = 0);
+
+    uint32_t size() const {return live_count;}
+    bool full() const {return live_count == capacity;}
+
+    // age as a fraction of the lifetime (0-1)
+    float age(uint32_t i) const {return age_ms[i] / float(lifetime_ms);}
+    Vec2 pos(uint32_t i) const {return Vec2(pos_x[i], pos_y[i]);}
+    Vec2 vel(uint32_t i) const {return Vec2(vel_x[i], vel_y[i]);}
+
+    bool emit(const Vec2 &pos, const Vec2 &vel, float user = 0.0f);
+    void remove(uint32_t i);
+    void clear();
+
+    void update(uint32_t time_ms);
+
+    void render(Surface &dest, const Point &offset, const Pen *ramp, uint32_t ramp_size);
+
+  private:
+    uint32_t live_count = 0;
+    uint32_t last_time_ms = 0;
+    uint32_t spawn_remainder = 0;
+    bool started = false;
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+/*! \file profile_zone.cpp
+    \brief Profiling zones
+*/
+#include "profile_zone.hpp"
+
+#ifdef BLIT_PROFILE_ZONES
+
+#include <algorithm>
+
+#include "api_private.hpp"
+
+namespace blit {
+
+  static ProfileZone *zones[BLIT_PROFILE_ZONE_MAX_ZONES];
+  static std::atomic<uint32_t> zone_count(0);
+
+  // double buffered, zones write to one while the last frame is read from the other
+  static ProfileZoneEvent events[2][BLIT_PROFILE_ZONE_MAX_EVENTS];
+  static std::atomic<uint32_t> event_count[2];
+  static std::atomic<uint8_t> write_buffer(0);
+
+  static uint32_t last_frame_count = 0;
+  static uint32_t last_frame_dropped = 0;
+
+  static uint16_t register_zone(ProfileZone &zone) {
+    uint32_t index = zone_count.fetch_add(1);
+
+    if(index == 0 && api.enable_us_timer)
+      api.enable_us_timer();
+
+    // too many zones, use an id without a name
+    if(index >= BLIT_PROFILE_ZONE_MAX_ZONES) {
+      zone_count = BLIT_PROFILE_ZONE_MAX_ZONES;
+
+      uint16_t expected = 0;
+      zone.id.compare_exchange_strong(expected, BLIT_PROFILE_ZONE_MAX_ZONES + 1);
+      return BLIT_PROFILE_ZONE_MAX_ZONES + 1;
+    }
+
+    zones[index] = &zone;
+
+    // another thread may have registered it first
+    uint16_t expected = 0;
+    if(!zone.id.compare_exchange_strong(expected, index + 1))
+      return expected;
+
+    return index + 1;
+  }
+
+  ScopedProfileZone::ScopedProfileZone(ProfileZone &zone) : zone(zone) {
+    start_us = api.get_us_timer();
+  }
+
+  ScopedProfileZone::~ScopedProfileZone() {
+    uint32_t end_us = api.get_us_timer();
+
+    uint16_t id = zone.id.load(std::memory_order_relaxed);
+    if(!id)
+      id = register_zone(zone);
+
+    uint32_t duration_us = end_us >= start_us ? end_us - start_us : (api.get_max_us_timer() - start_us) + end_us;
+
+    uint8_t buffer = write_buffer.load(std::memory_order_acquire);
+    uint32_t index = event_count[buffer].fetch_add(1, std::memory_order_relaxed);
+
+    if(index < BLIT_PROFILE_ZONE_MAX_EVENTS)
+      events[buffer][index] = {start_us, duration_us, id};
+  }
+
+  /**
+   * Finish the current frame, making its events available from get_profile_zone_events.
+   *
+   * Called by the engine at the end of each tick. Events from other threads that end while the buffers are
+   * swapped may be lost.
+   */
+  void profile_zones_end_frame() {
+    uint8_t finished = write_buffer.load();
+    uint8_t next = !finished;
+
+    event_count[next] = 0;
+    write_buffer.store(next, std::memory_order_release);
+
+    uint32_t count = event_count[finished].load();
+    last_frame_count = std::min(count, uint32_t(BLIT_PROFILE_ZONE_MAX_EVENTS));
+    last_frame_dropped = count - last_frame_count;
+  }
+
+  /**
+   * Get the events recorded in the last finished frame, in the order they ended.
+   *
+   * \param count Set to the number of events.
+   * \return Pointer to the events, valid until the next frame ends.
+   */
+  const ProfileZoneEvent *get_profile_zone_events(uint32_t &count) {
+    count = last_frame_count;
+    return events[!write_buffer.load()];
+  }
+
+  /**
+   * Get the number of events in the last finished frame that didn't fit in the buffer.
+   *
+   * \return Number of dropped events.
+   */
+  uint32_t get_profile_zone_dropped_events() {
+    return last_frame_dropped;
+  }
+
+  /**
+   * Get the number of registered zones. Zone ids start from 1.
+   *
+   * \return Number of zones.
+   */
+  uint16_t get_profile_zone_count() {
+    return std::min(zone_count.load(), uint32_t(BLIT_PROFILE_ZONE_MAX_ZONES));
+  }
+
+  /**
+   * Get the name of a zone.
+   *
+   * \param zone Zone id, from a ProfileZoneEvent.
+   * \return Name of the zone, or nullptr if the id is not valid.
+   */
+  const char *get_profile_zone_name(uint16_t zone) {
+    if(zone == 0 || zone > get_profile_zone_count() || !zones[zone - 1])
+      return nullptr;
+
+    return zones[zone - 1]->name;
+  }
+}
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+// Profiling zones
+//
+// Lightweight timing for hot code that can be left in release builds. Zones only exist when the engine is
+// built with BLIT_PROFILE_ZONES defined (-DPROFILE_ZONES=1 when configuring), otherwise the macro expands to nothing.
+//
+// void draw_things() {
+//   blit_profile_zone("draw_things");
+//   ...
+// }
+//
+// Each zone is a static object, registered the first time it completes. When a zone ends an event with its start time
+// and duration is added to the current frame's buffer, this doesn't lock so zones can also be used from the audio
+// thread/interrupt. The engine finishes the frame at the end of each tick, the events of the last finished frame can
+// then be read with get_profile_zone_events().
+
+#ifdef BLIT_PROFILE_ZONES
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef BLIT_PROFILE_ZONE_MAX_EVENTS
+#define BLIT_PROFILE_ZONE_MAX_EVENTS 1024
+#endif
+
+#ifndef BLIT_PROFILE_ZONE_MAX_ZONES
+#define BLIT_PROFILE_ZONE_MAX_ZONES 64
+#endif
+
+#define BLIT_PROFILE_ZONE_CONCAT2(a, b) a##b
+#define BLIT_PROFILE_ZONE_CONCAT(a, b) BLIT_PROFILE_ZONE_CONCAT2(a, b)
+
+#define blit_profile_zone(name) \
+  static blit::ProfileZone BLIT_PROFILE_ZONE_CONCAT(blit_profile_zone_, __LINE__)(name); \
+  blit::ScopedProfileZone BLIT_PROFILE_ZONE_CONCAT(blit_scoped_profile_zone_, __LINE__)(BLIT_PROFILE_ZONE_CONCAT(blit_profile_zone_, __LINE__))
+
+namespace blit {
+  struct ProfileZone {
+    constexpr ProfileZone(const char *name) : name(name), id(0) {}
+
+    const char *name;
+    std::atomic<uint16_t> id; // 0 until registered
+  };
+
+  struct ProfileZoneEvent {
+    uint32_t start_us;
+    uint32_t duration_us;
+    uint16_t zone;
+  };
+
+  class ScopedProfileZone {
+  public:
+    explicit ScopedProfileZone(ProfileZone &zone);
+    ~ScopedProfileZone();
+
+    ScopedProfileZone(const ScopedProfileZone &) = delete;
+    ScopedProfileZone &operator=(const ScopedProfileZone &) = delete;
+
+  private:
+    ProfileZone &zone;
+    uint32_t start_us;
+  };
+
+  void profile_zones_end_frame();
+
+  const ProfileZoneEvent *get_profile_zone_events(uint32_t &count);
+  uint32_t get_profile_zone_dropped_events();
+
+  uint16_t get_profile_zone_count();
+  const char *get_profile_zone_name(uint16_t zone);
+}
+
+#else
+
+#define blit_profile_zone(name)
+
+#endif
@@ -1,17 +1,150 @@
 #include <cinttypes>
+#include <cstring>
 
 #include "profiler.hpp"
 #include "engine/api_private.hpp"
 #include "engine/engine.hpp"
+#include "engine/file.hpp"
 #include "graphics/color.hpp"
 #include "graphics/font.hpp"
 
 namespace blit
 {
 
+// time between two us timer values, handling the timer wrapping
+static uint32_t us_timer_diff(uint32_t uStartUs, uint32_t uEndUs)
+{
+	if(uEndUs >= uStartUs)
+		return uEndUs - uStartUs;
+
+	return (api.get_max_us_timer() - uStartUs) + uEndUs;
+}
+
+ProfilerTrace::ProfilerTrace(uint32_t uMaxEvents) : m_uMaxEvents(uMaxEvents)
+{
+	m_pEvents = new Event[uMaxEvents];
+}
+
+ProfilerTrace::~ProfilerTrace()
+{
+	delete[] m_pEvents;
+}
+
+void ProfilerTrace::add_event(const char *pszName, EventType type)
+{
+	if(!m_bEnabled || !m_uMaxEvents)
+		return;
+
+	uint32_t uRawUs = api.get_us_timer();
+
+	if(!m_bStarted)
+	{
+		m_uLastRawUs = uRawUs;
+		m_bStarted = true;
+	}
+
+	m_uTimeUs += us_timer_diff(m_uLastRawUs, uRawUs);
+	m_uLastRawUs = uRawUs;
+
+	// overwrite the oldest event when full
+	m_pEvents[m_uNext] = {pszName, m_uTimeUs, type};
+	m_uNext = (m_uNext + 1) % m_uMaxEvents;
+
+	if(m_uCount < m_uMaxEvents)
+		m_uCount++;
+}
+
+void ProfilerTrace::clear()
+{
+	m_uCount = 0;
+	m_uNext = 0;
+}
+
+// events are indexed from the oldest
+const ProfilerTrace::Event &ProfilerTrace::get_event(size_t uIndex)
+{
+	return m_pEvents[(m_uNext + m_uMaxEvents - m_uCount + uIndex) % m_uMaxEvents];
+}
+
+void ProfilerTrace::write_json(std::function<void(const char *, size_t)> write)
+{
+	char buffer[160];
+	int iDepth = 0;
+	bool bFirst = true;
+
+	const char *pszHeader = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	write(pszHeader, strlen(pszHeader));
+
+	for(size_t uEvent = 0; uEvent < m_uCount; uEvent++)
+	{
+		const Event &event = get_event(uEvent);
+
+		// skip ends where the start was overwritten
+		if(event.type == etEnd)
+		{
+			if(iDepth == 0)
+				continue;
+			iDepth--;
+		}
+		else
+			iDepth++;
+
+		// names are expected to be simple labels, drop anything that would need escaping
+		char szName[64];
+		size_t uNameLen = 0;
+		for(const char *pszIn = event.pszName; *pszIn && uNameLen < sizeof(szName) - 1; pszIn++)
+		{
+			if(*pszIn != '"' && *pszIn != '\\' && (uint8_t)*pszIn >= ' ')
+				szName[uNameLen++] = *pszIn;
+		}
+		szName[uNameLen] = 0;
+
+		int iLen = snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu32 ",\"pid\":0,\"tid\":0}",
+			bFirst ? "" : ",\n", szName, event.type == etBegin ? 'B' : 'E', event.uTimeUs);
+		write(buffer, std::min(size_t(iLen), sizeof(buffer) - 1));
+
+		bFirst = false;
+	}
+
+	const char *pszFooter = "\n]}\n";
+	write(pszFooter, strlen(pszFooter));
+}
+
+// save as a Chrome trace event JSON file
+bool ProfilerTrace::save(const std::string &filename)
+{
+	File file(filename, OpenMode::write);
+	if(!file.is_open())
+		return false;
+
+	uint32_t uOffset = 0;
+	bool bOk = true;
+
+	write_json([&](const char *pData, size_t uLen)
+	{
+		if(file.write(uOffset, uLen, pData) != int32_t(uLen))
+			bOk = false;
+		uOffset += uLen;
+	});
+
+	return bOk;
+}
+
+// write the JSON to the debug output, save() should be preferred if there is storage
+void ProfilerTrace::log()
+{
+	write_json([](const char *pData, size_t uLen)
+	{
+		debugf("%.*s", int(uLen), pData);
+	});
+}
+
 void ProfilerProbe::start()
 {
 	m_uStartUs = api.get_us_timer();
+
+	if(m_pTrace)
+		m_pTrace->begin(m_pszName);
 }
 
 uint32_t ProfilerProbe::store_elapsed_us(bool bRestart)
@@ -19,10 +152,10 @@ uint32_t ProfilerProbe::store_elapsed_us(bool bRestart)
 	if(m_uStartUs)
 	{
 		uint32_t uCurrentUs = api.get_us_timer();
-		if(uCurrentUs >= m_uStartUs)
-			m_metrics.uElapsedUs = uCurrentUs - m_uStartUs;
-		else
-			m_metrics.uElapsedUs = (api.get_max_us_timer() - m_uStartUs) + uCurrentUs;
+		m_metrics.uElapsedUs = us_timer_diff(m_uStartUs, uCurrentUs);
+
+		if(m_pTrace)
+			m_pTrace->end(m_pszName);
 
 		m_metrics.uMinElapsedUs = std::min(m_metrics.uMinElapsedUs, m_metrics.uElapsedUs);
 		m_metrics.uMaxElapsedUs = std::max(m_metrics.uMaxElapsedUs, m_metrics.uElapsedUs);
@@ -42,7 +175,12 @@ uint32_t ProfilerProbe::store_elapsed_us(bool bRestart)
 	}
 
 	if(bRestart)
-	m_uStartUs = api.get_us_timer();
+	{
+		m_uStartUs = api.get_us_timer();
+
+		if(m_pTrace)
+			m_pTrace->begin(m_pszName);
+	}
 
 	return m_metrics.uElapsedUs;
 }
@@ -64,6 +202,7 @@ Profiler::Profiler(uint32_t uRunningAverageSize, uint32_t uRunningAverageSpan )
 
 Profiler::~Profiler()
 {
+	delete m_pTrace;
 }
 
 
@@ -71,6 +210,7 @@ Profiler::~Profiler()
 ProfilerProbe *Profiler::add_probe(const char *pszName)
 {
 	ProfilerProbe *pProbe = new ProfilerProbe(pszName, m_uRunningAverageSize, m_uRunningAverageSpan);
+	pProbe->set_trace(m_pTrace);
 	m_probes.push_back(pProbe);
 
 	return pProbe;
@@ -79,6 +219,7 @@ ProfilerProbe *Profiler::add_probe(const char *pszName)
 ProfilerProbe *Profiler::add_probe(const char *pszName,  uint32_t uRunningAverageSize, uint32_t uRunningAverageSpan)
 {
 	ProfilerProbe *pProbe = new ProfilerProbe(pszName, uRunningAverageSize, uRunningAverageSpan);
+	pProbe->set_trace(m_pTrace);
 	m_probes.push_back(pProbe);
 
 	return pProbe;
@@ -158,6 +299,25 @@ void Profiler::setup_graph_element(DisplayMetric metric, bool bDisplayLabel, boo
 	m_graphElements[metric].color = color;
 }
 
+// start recording probe events, keeping the most recent uMaxEvents
+ProfilerTrace *Profiler::enable_trace(uint32_t uMaxEvents)
+{
+	if(!m_pTrace)
+	{
+		m_pTrace = new ProfilerTrace(uMaxEvents);
+
+		for(ProfilerProbe *pProbe : m_probes)
+			pProbe->set_trace(m_pTrace);
+	}
+
+	return m_pTrace;
+}
+
+ProfilerTrace *Profiler::get_trace()
+{
+	return m_pTrace;
+}
+
 void Profiler::display_history(bool bDisplayHistory, Pen color)
 {
 	m_bDisplayHistory = bDisplayHistory;
@@ -12,9 +12,13 @@
 //
 // Values can be displayed as an overlay when called at the end of Render() using DisplayProbeOverlay()
 //
+// A ProfilerTrace can record the start/end of each probe into a ring buffer, enabled with enable_trace().
+// This can be saved as a Chrome trace event JSON file (chrome://tracing or ui.perfetto.dev) to view as a timeline.
+//
 // For examples of use and setup please see the profiler-test example.
 
 #include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -24,6 +28,69 @@
 
 namespace blit
 {
+class ProfilerTrace
+{
+public:
+	enum EventType : uint8_t {etBegin, etEnd};
+
+	struct Event
+	{
+		const char	*pszName;
+		uint32_t		uTimeUs;		// time since the trace was started
+		EventType		type;
+	};
+
+	explicit ProfilerTrace(uint32_t uMaxEvents);
+	~ProfilerTrace();
+	ProfilerTrace(const ProfilerTrace &) = delete;
+	ProfilerTrace &operator=(const ProfilerTrace &) = delete;
+
+	void begin(const char *pszName)
+	{
+		add_event(pszName, etBegin);
+	}
+
+	void end(const char *pszName)
+	{
+		add_event(pszName, etEnd);
+	}
+
+	void clear();
+
+	void set_enabled(bool bEnabled)
+	{
+		m_bEnabled = bEnabled;
+	}
+
+	bool is_enabled()
+	{
+		return m_bEnabled;
+	}
+
+	size_t get_event_count()
+	{
+		return m_uCount;
+	}
+
+	const Event &get_event(size_t uIndex);
+
+	bool save(const std::string &filename);
+	void log();
+
+private:
+	void add_event(const char *pszName, EventType type);
+	void write_json(std::function<void(const char *, size_t)> write);
+
+	Event			*m_pEvents;
+	uint32_t	m_uMaxEvents;
+	uint32_t	m_uCount = 0;
+	uint32_t	m_uNext = 0;
+	uint32_t	m_uLastRawUs = 0;
+	uint32_t	m_uTimeUs = 0;
+	bool			m_bStarted = false;
+	bool			m_bEnabled = true;
+};
+
 class ProfilerProbe
 {
 public:
@@ -63,7 +130,7 @@ public:
 	};
 
 
-	ProfilerProbe(const char *pszName, uint32_t uRunningAverageSize = 0, uint32_t uRunningAverageSpan = 1) : m_pszName(pszName), m_uStartUs(0), m_metrics(), m_pRunningAverage(nullptr), m_uGraphTimeUs(20000)
+	ProfilerProbe(const char *pszName, uint32_t uRunningAverageSize = 0, uint32_t uRunningAverageSpan = 1) : m_pszName(pszName), m_uStartUs(0), m_metrics(), m_pRunningAverage(nullptr), m_uGraphTimeUs(20000), m_pTrace(nullptr)
 	{
 		if(uRunningAverageSize)
 		{
@@ -118,6 +185,11 @@ public:
 		return m_uGraphTimeUs;
 	}
 
+	void set_trace(ProfilerTrace *pTrace)
+	{
+		m_pTrace = pTrace;
+	}
+
 private:
 	const char 						*m_pszName;
 	uint32_t							m_uStartUs;
@@ -126,6 +198,7 @@ private:
 	uint32_t							m_uRunningAverageSpan;
 	uint32_t							m_uRunningAverageSpanIndex;
 	uint32_t							m_uGraphTimeUs;
+	ProfilerTrace					*m_pTrace;
 };
 
 
@@ -192,6 +265,9 @@ public:
 	void 					setup_graph_element(DisplayMetric metric, bool bDisplayLabel, bool bDisplayGraph, Pen color);
 	GraphElement  &get_graph_element(DisplayMetric metric);
 
+	ProfilerTrace	*enable_trace(uint32_t uMaxEvents = 4096);
+	ProfilerTrace	*get_trace();
+
 private:
 	static const char *g_pszMetricNames[];
 
@@ -210,6 +286,7 @@ private:
 	uint8_t					m_uAlpha;
 	bool					m_bDisplayHistory;
 	Pen						m_historyColor;
+	ProfilerTrace	*m_pTrace = nullptr;
 
 };
 }; // namespace
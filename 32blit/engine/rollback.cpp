@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cstring>
+
+#include "rollback.hpp"
+#include "engine.hpp"
+#include "multiplayer.hpp"
+
+namespace blit {
+
+  // "RB", sender nonce, ack, first frame, count, then count inputs
+  static const int header_size = 15;
+  static const uint32_t max_inputs_per_message = 255;
+
+  static const uint32_t no_rollback = ~0u;
+
+  static void write32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+  }
+
+  static uint32_t read32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+  }
+
+  /**
+   * Create a session. The callbacks need to be set before the first update. Nothing here uses the API, so a session
+   * can be a global.
+   *
+   * \param state_size Size of the state written by `save_state`
+   * \param max_rollback Number of steps that can be rolled back, also how far the other player can fall behind
+   * \param input_delay Number of steps before local input is used, trades latency for fewer rollbacks
+   */
+  RollbackSession::RollbackSession(uint32_t state_size, uint32_t max_rollback, uint32_t input_delay)
+    : state_size(state_size), max_rollback(std::max(max_rollback, 1u)), input_delay(input_delay) {
+
+    states.resize(state_size * this->max_rollback);
+
+    // inputs are kept from before the oldest the other player may not have, to after the newest they may send
+    inputs.resize((this->max_rollback + input_delay + 1) * 3);
+
+    reset();
+  }
+
+  /**
+   * Advance the simulation by one step. Call from `update`.
+   *
+   * Until the other player is found this only announces the session. Corrections that have arrived are applied
+   * first, which may simulate several steps.
+   *
+   * \param local_input Input for the local player, usually `blit::buttons`
+   * \return false if the session is waiting for the other player
+   */
+  bool RollbackSession::update(uint32_t local_input) {
+    pick_nonce();
+
+    if(!running) {
+      send_inputs();
+      return false;
+    }
+
+    if(rollback_frame != no_rollback)
+      roll_back();
+
+    // too far ahead of the other player to roll back if needed
+    if(frame >= remote_frames + max_rollback) {
+      stats.stalls++;
+      send_inputs();
+      return false;
+    }
+
+    auto &entry = input(frame + input_delay);
+    entry.local = local_input;
+    entry.local_known = true;
+    local_frames = frame + input_delay + 1;
+
+    send_inputs();
+
+    advance();
+
+    return true;
+  }
+
+  /**
+   * Handle a message from the other player. Call from `message_received`.
+   *
+   * \return false if the message isn't for the session
+   */
+  bool RollbackSession::message_received(const uint8_t *data, uint16_t len) {
+    if(len < header_size || data[0] != 'R' || data[1] != 'B')
+      return false;
+
+    auto sender = read32(data + 2);
+    auto ack = read32(data + 6);
+    auto first = read32(data + 10);
+    uint32_t count = data[14];
+
+    if(len != header_size + count * 4)
+      return true;
+
+    if(!running) {
+      pick_nonce();
+
+      if(sender == nonce) {
+        // both picked the same number, try again
+        nonce = blit::random() | 1;
+        return true;
+      }
+
+      remote_nonce = sender;
+      local_player = nonce < remote_nonce ? 0 : 1;
+      running = true;
+    } else if(sender != remote_nonce)
+      return true; // not the session we started with
+
+    remote_acked = std::max(remote_acked, std::min(ack, local_frames));
+
+    auto in = data + header_size;
+    for(uint32_t i = 0; i < count; i++, in += 4) {
+      auto remote_frame = first + i;
+
+      // already have it, or too far ahead to be valid
+      if(remote_frame < remote_frames)
+        continue;
+
+      if(remote_frame >= frame + max_rollback + input_delay * 2 + 2)
+        break;
+
+      auto &entry = input(remote_frame);
+      if(entry.remote_known)
+        continue;
+
+      entry.remote = read32(in);
+      entry.remote_known = true;
+
+      // the prediction was wrong, roll back to here on the next update
+      if(remote_frame < frame && entry.used_remote != entry.remote)
+        rollback_frame = std::min(rollback_frame, remote_frame);
+    }
+
+    while(true) {
+      auto &entry = inputs[remote_frames % inputs.size()];
+      if(entry.frame != remote_frames || !entry.remote_known)
+        break;
+
+      last_remote_input = entry.remote;
+      remote_frames++;
+    }
+
+    return true;
+  }
+
+  /**
+   * Start a new session, the other player also needs to reset.
+   */
+  void RollbackSession::reset() {
+    running = false;
+    local_player = 0;
+    nonce = 0; // picked on first use, the API may not be set up yet
+    remote_nonce = 0;
+
+    frame = 0;
+    remote_frames = 0;
+    remote_acked = 0;
+    last_remote_input = 0;
+    rollback_frame = no_rollback;
+
+    for(auto &entry : inputs)
+      entry = {~0u, 0, 0, 0, false, false};
+
+    // no local input for the first input_delay steps
+    for(local_frames = 0; local_frames < input_delay; local_frames++) {
+      auto &entry = input(local_frames);
+      entry.local = 0;
+      entry.local_known = true;
+    }
+
+    stats = Stats();
+  }
+
+  /**
+   * \return true once the other player has been found
+   */
+  bool RollbackSession::is_running() const {
+    return running;
+  }
+
+  /**
+   * \return 0 or 1, the index of the local input passed to `simulate`
+   */
+  int RollbackSession::get_local_player() const {
+    return local_player;
+  }
+
+  /**
+   * \return The number of steps simulated
+   */
+  uint32_t RollbackSession::get_frame() const {
+    return frame;
+  }
+
+  /**
+   * \return The number of steps with both inputs known, these will not be rolled back
+   */
+  uint32_t RollbackSession::get_confirmed_frame() const {
+    return std::min(frame, remote_frames);
+  }
+
+  const RollbackSession::Stats &RollbackSession::get_stats() const {
+    return stats;
+  }
+
+  RollbackSession::InputEntry &RollbackSession::input(uint32_t input_frame) {
+    auto &entry = inputs[input_frame % inputs.size()];
+
+    if(entry.frame != input_frame)
+      entry = {input_frame, 0, 0, 0, false, false};
+
+    return entry;
+  }
+
+  void RollbackSession::pick_nonce() {
+    if(!nonce)
+      nonce = blit::random() | 1;
+  }
+
+  void RollbackSession::advance() {
+    auto &entry = input(frame);
+
+    // predict that the remote input hasn't changed
+    entry.used_remote = entry.remote_known ? entry.remote : last_remote_input;
+
+    uint32_t step_inputs[2];
+    step_inputs[local_player] = entry.local;
+    step_inputs[1 - local_player] = entry.used_remote;
+
+    save_state(states.data() + (frame % max_rollback) * state_size);
+    simulate(step_inputs);
+
+    frame++;
+  }
+
+  void RollbackSession::roll_back() {
+    auto depth = frame - rollback_frame;
+    auto target = frame;
+
+    load_state(states.data() + (rollback_frame % max_rollback) * state_size);
+
+    for(frame = rollback_frame; frame < target;)
+      advance();
+
+    stats.rollbacks++;
+    stats.resimulated_steps += depth;
+    stats.max_depth = std::max(stats.max_depth, depth);
+
+    rollback_frame = no_rollback;
+  }
+
+  // send every local input the other player doesn't have yet, so that a lost message doesn't need a resend
+  void RollbackSession::send_inputs() {
+    if(!is_multiplayer_connected())
+      return;
+
+    uint8_t buf[header_size + max_inputs_per_message * 4];
+
+    auto first = remote_acked;
+    auto count = std::min(local_frames - first, max_inputs_per_message);
+
+    buf[0] = 'R';
+    buf[1] = 'B';
+    write32(buf + 2, nonce);
+    write32(buf + 6, remote_frames);
+    write32(buf + 10, first);
+    buf[14] = count;
+
+    for(uint32_t i = 0; i < count; i++)
+      write32(buf + header_size + i * 4, inputs[(first + i) % inputs.size()].local);
+
+    send_message(buf, header_size + count * 4);
+  }
+}
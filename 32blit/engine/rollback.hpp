@@ -0,0 +1,96 @@
+#pragma once
+
+// Rollback netcode for two players
+//
+// Both instances run the same deterministic simulation, one step per update(). Each step the local input is sent to
+// the other player and the simulation advances straight away, predicting that the remote input hasn't changed since
+// the last one received. When the real remote input arrives and differs from the prediction, the state from before
+// that step is restored and the steps since are simulated again. Snapshots are kept in a ring, so a session can only
+// roll back max_rollback steps and waits for the other player if they fall further behind than that.
+//
+// GameState state;
+// blit::RollbackSession rollback(sizeof(GameState));
+//
+// void init() {
+//   rollback.save_state = [](uint8_t *data) {memcpy(data, &state, sizeof(state));};
+//   rollback.load_state = [](const uint8_t *data) {memcpy(&state, data, sizeof(state));};
+//   rollback.simulate = [](const uint32_t *inputs) {state.step(inputs[0], inputs[1]);};
+//
+//   blit::message_received = [](const uint8_t *data, uint16_t len) {rollback.message_received(data, len);};
+//   blit::enable_multiplayer();
+// }
+//
+// void update(uint32_t time) {
+//   rollback.update(blit::buttons);
+// }
+//
+// Everything simulate() depends on has to be in the saved state. That includes any random number generator, as
+// blit::random() gives different values on each instance.
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace blit {
+  class RollbackSession final {
+  public:
+    using SaveCallback = std::function<void(uint8_t *state)>;
+    using LoadCallback = std::function<void(const uint8_t *state)>;
+    using SimulateCallback = std::function<void(const uint32_t *inputs)>; // inputs[player]
+
+    struct Stats {
+      uint32_t rollbacks = 0;          // number of corrections
+      uint32_t resimulated_steps = 0;  // steps simulated again
+      uint32_t max_depth = 0;          // most steps rolled back at once
+      uint32_t stalls = 0;             // updates spent waiting for the other player
+    };
+
+    RollbackSession(uint32_t state_size, uint32_t max_rollback = 8, uint32_t input_delay = 0);
+
+    bool update(uint32_t local_input);
+    bool message_received(const uint8_t *data, uint16_t len);
+    void reset();
+
+    bool is_running() const;
+    int get_local_player() const;
+    uint32_t get_frame() const;
+    uint32_t get_confirmed_frame() const;
+    const Stats &get_stats() const;
+
+    SaveCallback save_state = nullptr;
+    LoadCallback load_state = nullptr;
+    SimulateCallback simulate = nullptr;
+
+  private:
+    struct InputEntry {
+      uint32_t frame;
+      uint32_t local, remote;
+      uint32_t used_remote; // what the simulation used, maybe a prediction
+      bool local_known, remote_known;
+    };
+
+    InputEntry &input(uint32_t input_frame);
+    void pick_nonce();
+    void advance();
+    void roll_back();
+    void send_inputs();
+
+    uint32_t state_size, max_rollback, input_delay;
+
+    std::vector<uint8_t> states; // state before each of the last max_rollback steps
+    std::vector<InputEntry> inputs;
+
+    bool running = false;
+    int local_player = 0;
+    uint32_t nonce = 0, remote_nonce = 0; // 0 until picked
+
+    uint32_t frame = 0;          // next step to simulate
+    uint32_t local_frames = 0;   // local inputs known
+    uint32_t remote_frames = 0;  // remote inputs known without gaps
+    uint32_t remote_acked = 0;   // local inputs the other player has
+    uint32_t last_remote_input = 0;
+    uint32_t rollback_frame;     // earliest misprediction
+
+    Stats stats;
+  };
+}
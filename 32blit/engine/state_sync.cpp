@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cstring>
+
+#include "state_sync.hpp"
+#include "multiplayer.hpp"
+
+namespace blit {
+
+  // "SD", id, sequence, base sequence, ack, then the delta
+  static const int header_size = 9;
+
+  // a run of at least this many unchanged bytes ends a block of changes
+  static const uint32_t min_skip = 3;
+
+  static void write16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+  }
+
+  static uint16_t read16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+  }
+
+  // sequence numbers wrap, 0 is never used
+  static uint16_t next_sequence(uint16_t sequence) {
+    return sequence == 0xFFFF ? 1 : sequence + 1;
+  }
+
+  static bool is_newer(uint16_t a, uint16_t b) {
+    return b == 0 || int16_t(a - b) > 0;
+  }
+
+  // the delta is a list of blocks, each starting with a control byte:
+  //   0x00-0x7F skip (n + 1) unchanged bytes
+  //   0x80-0xFF (n - 0x7F) bytes to XOR follow
+  // anything after the last block is unchanged
+  uint32_t delta_encode(const uint8_t *data, const uint8_t *base, uint32_t size, uint8_t *out) {
+    auto diff = [data, base](uint32_t i) -> uint8_t {
+      return base ? data[i] ^ base[i] : data[i];
+    };
+
+    auto zeros_at = [&diff, size](uint32_t i, uint32_t max) {
+      uint32_t count = 0;
+      while(i + count < size && count < max && diff(i + count) == 0)
+        count++;
+      return count;
+    };
+
+    auto start = out;
+    uint32_t i = 0;
+
+    while(i < size) {
+      auto skip = zeros_at(i, ~0u);
+
+      if(i + skip == size)
+        break;
+
+      for(i += skip; skip; skip -= std::min(skip, 128u))
+        *out++ = std::min(skip, 128u) - 1;
+
+      // changed bytes, including any short runs of unchanged ones
+      auto end = i;
+      while(end < size && end - i < 128) {
+        auto zeros = zeros_at(end, min_skip);
+
+        if(!zeros)
+          end++;
+        else if(zeros < min_skip && end + zeros < size && end + zeros - i <= 128)
+          end += zeros;
+        else
+          break;
+      }
+
+      *out++ = 0x80 + (end - i - 1);
+      for(; i < end; i++)
+        *out++ = diff(i);
+    }
+
+    return out - start;
+  }
+
+  bool delta_decode(const uint8_t *delta, uint32_t delta_size, const uint8_t *base, uint32_t size, uint8_t *out) {
+    if(!base)
+      memset(out, 0, size);
+    else if(out != base)
+      memcpy(out, base, size);
+
+    auto end = delta + delta_size;
+    uint32_t i = 0;
+
+    while(delta < end) {
+      auto control = *delta++;
+
+      if(control < 0x80) {
+        i += control + 1;
+        continue;
+      }
+
+      uint32_t count = control - 0x7F;
+      if(i + count > size || delta + count > end)
+        return false;
+
+      for(; count; count--)
+        out[i++] ^= *delta++;
+    }
+
+    return i <= size;
+  }
+
+  /**
+   * \param id Identifies this state if there is more than one, both sides need to use the same id
+   * \param state_size Size of the state
+   * \param history Number of old states to keep to diff against, more helps when there's a lot of latency
+   */
+  StateSync::StateSync(uint8_t id, uint32_t state_size, uint32_t history) : id(id), state_size(state_size), history(std::max(history, 1u)) {
+    sent_states.resize(state_size * this->history);
+    received_states.resize(state_size * this->history);
+    sent_sequences.resize(this->history);
+    received_sequences.resize(this->history);
+
+    message.resize(header_size + max_delta_size(state_size));
+
+    reset();
+  }
+
+  /**
+   * Send the current state, as a delta from the newest one the other side has.
+   *
+   * \param state State to send, `state_size` bytes
+   */
+  void StateSync::send(const void *state) {
+    if(!is_multiplayer_connected())
+      return;
+
+    auto data = static_cast<const uint8_t *>(state);
+    auto base = acked ? sent_state(acked) : nullptr;
+
+    sequence = next_sequence(sequence);
+
+    message[0] = 'S';
+    message[1] = 'D';
+    message[2] = id;
+    write16(message.data() + 3, sequence);
+    write16(message.data() + 5, base ? acked : 0);
+    write16(message.data() + 7, remote_sequence);
+
+    auto len = header_size + delta_encode(data, base, state_size, message.data() + header_size);
+
+    // keep it to diff against once it's acknowledged, done last as it may replace the base
+    auto slot = sequence % history;
+    memcpy(sent_states.data() + slot * state_size, data, state_size);
+    sent_sequences[slot] = sequence;
+
+    send_message(message.data(), len);
+
+    stats.sent++;
+    if(!base)
+      stats.keyframes++;
+    stats.state_bytes += state_size;
+    stats.sent_bytes += len;
+
+    ack_pending = false;
+  }
+
+  /**
+   * Acknowledge the newest state received, if it hasn't been already. Only needed if `send` isn't called.
+   */
+  void StateSync::send_ack() {
+    if(!ack_pending || !is_multiplayer_connected())
+      return;
+
+    uint8_t ack[header_size]{'S', 'D', id, 0, 0, 0, 0};
+    write16(ack + 7, remote_sequence);
+
+    send_message(ack, header_size);
+    stats.sent_bytes += header_size;
+
+    ack_pending = false;
+  }
+
+  /**
+   * Handle a message from the other player. Call from `message_received`.
+   *
+   * \return false if the message isn't for this state
+   */
+  bool StateSync::message_received(const uint8_t *data, uint16_t len) {
+    if(len < header_size || data[0] != 'S' || data[1] != 'D' || data[2] != id)
+      return false;
+
+    auto msg_sequence = read16(data + 3);
+    auto base_sequence = read16(data + 5);
+    auto ack = read16(data + 7);
+
+    // follow the other side even if it goes back (after a reset or a state being dropped), but ignore acks for states
+    // we haven't sent
+    if(!ack || !is_newer(ack, sequence))
+      acked = ack;
+
+    if(!msg_sequence)
+      return true;
+
+    if(!is_newer(msg_sequence, remote_sequence)) {
+      stats.dropped++; // late
+      return true;
+    }
+
+    const uint8_t *base = nullptr;
+    if(base_sequence) {
+      base = received_state(base_sequence);
+
+      if(!base) {
+        stats.dropped++;
+        return true;
+      }
+    }
+
+    // the new state may replace the base, so decode to the message buffer first
+    if(!delta_decode(data + header_size, len - header_size, base, state_size, message.data())) {
+      stats.dropped++;
+      return true;
+    }
+
+    auto slot = msg_sequence % history;
+    memcpy(received_states.data() + slot * state_size, message.data(), state_size);
+    received_sequences[slot] = msg_sequence;
+
+    remote_sequence = msg_sequence;
+    ack_pending = true;
+    stats.received++;
+
+    return true;
+  }
+
+  /**
+   * Forget all states, the next one sent is a keyframe. The other side needs to reset too.
+   */
+  void StateSync::reset() {
+    std::fill(sent_sequences.begin(), sent_sequences.end(), 0);
+    std::fill(received_sequences.begin(), received_sequences.end(), 0);
+
+    sequence = acked = remote_sequence = 0;
+    ack_pending = false;
+
+    stats = Stats();
+  }
+
+  /**
+   * \return The newest state received, or nullptr if there isn't one yet
+   */
+  const uint8_t *StateSync::get_remote_state() const {
+    if(!remote_sequence)
+      return nullptr;
+
+    return received_states.data() + (remote_sequence % history) * state_size;
+  }
+
+  /**
+   * \return Sequence number of the newest state received, changes when a new state arrives
+   */
+  uint16_t StateSync::get_remote_sequence() const {
+    return remote_sequence;
+  }
+
+  const StateSync::Stats &StateSync::get_stats() const {
+    return stats;
+  }
+
+  uint8_t *StateSync::sent_state(uint16_t sent_sequence) {
+    auto slot = sent_sequence % history;
+    return sent_sequences[slot] == sent_sequence ? sent_states.data() + slot * state_size : nullptr;
+  }
+
+  uint8_t *StateSync::received_state(uint16_t received_sequence) {
+    auto slot = received_sequence % history;
+    return received_sequences[slot] == received_sequence ? received_states.data() + slot * state_size : nullptr;
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Delta compressed state sync
+//
+// Sends a block of state to the other player each time send() is called, encoded as the difference from the last
+// state they acknowledged. Unchanged bytes cost almost nothing, so only what changed uses up the link. Each message
+// carries an acknowledgement of the newest state received from the other side. If the other player only receives,
+// it should call send_ack() instead.
+//
+// struct Shared {...} local, remote;
+// blit::StateSync sync(0, sizeof(Shared));
+//
+// void update(uint32_t time) {
+//   sync.send(&local);
+//
+//   if(auto state = sync.get_remote_state())
+//     memcpy(&remote, state, sizeof(remote));
+// }
+//
+// void on_message(const uint8_t *data, uint16_t len) {
+//   if(sync.message_received(data, len))
+//     return;
+//   ...
+// }
+//
+// Older states that arrive late are dropped, so get_remote_state() is always the newest.
+
+#include <cstdint>
+#include <vector>
+
+namespace blit {
+  /**
+   * Encode the difference between two buffers
+   *
+   * The output is at most `max_delta_size(size)` bytes.
+   *
+   * \param data New data
+   * \param base Data to diff against, or nullptr to encode all of `data`
+   * \param size Size of both buffers
+   * \param out Output buffer
+   * \return Size of the encoded delta
+   */
+  uint32_t delta_encode(const uint8_t *data, const uint8_t *base, uint32_t size, uint8_t *out);
+
+  /**
+   * Apply a delta from `delta_encode`
+   *
+   * \param delta Encoded delta
+   * \param delta_size Size of the delta
+   * \param base Data the delta was made against, or nullptr
+   * \param size Size of the data
+   * \param out Output buffer, may be the same as `base`
+   * \return false if the delta is invalid
+   */
+  bool delta_decode(const uint8_t *delta, uint32_t delta_size, const uint8_t *base, uint32_t size, uint8_t *out);
+
+  constexpr uint32_t max_delta_size(uint32_t size) {
+    return size + (size + 127) / 128;
+  }
+
+  class StateSync final {
+  public:
+    struct Stats {
+      uint32_t sent = 0, keyframes = 0;    // keyframes are sent when there's no acknowledged state to diff against
+      uint32_t received = 0, dropped = 0;  // dropped if late or if the base state is gone
+      uint32_t state_bytes = 0;            // size of the states sent
+      uint32_t sent_bytes = 0;             // size of the messages sent
+    };
+
+    StateSync(uint8_t id, uint32_t state_size, uint32_t history = 8);
+
+    void send(const void *state);
+    void send_ack();
+    bool message_received(const uint8_t *data, uint16_t len);
+    void reset();
+
+    const uint8_t *get_remote_state() const;
+    uint16_t get_remote_sequence() const;
+    const Stats &get_stats() const;
+
+  private:
+    uint8_t *sent_state(uint16_t sequence);
+    uint8_t *received_state(uint16_t sequence);
+
+    uint8_t id;
+    uint32_t state_size, history;
+
+    // last few states each way, the other side may diff against any of them
+    std::vector<uint8_t> sent_states, received_states;
+    std::vector<uint16_t> sent_sequences, received_sequences;
+
+    std::vector<uint8_t> message;
+
+    uint16_t sequence = 0;        // last sent
+    uint16_t acked = 0;           // newest of ours the other side has
+    uint16_t remote_sequence = 0; // newest received
+    bool ack_pending = false;
+
+    Stats stats;
+  };
+}
@@ -4,7 +4,90 @@
 #include "timer.hpp"
 
 namespace blit {
-  std::vector<Timer *> timers;
+  // running timers, as a binary min-heap ordered by due time then start order
+  static std::vector<Timer *> timer_heap;
+  static uint32_t next_timer_order = 0;
+
+  // compare with wrap-around so that the heap keeps working when the time overflows
+  static bool timer_before(const Timer *a, const Timer *b) {
+    int32_t diff = int32_t(a->due - b->due);
+    if(diff != 0)
+      return diff < 0;
+
+    return int32_t(a->order - b->order) < 0;
+  }
+
+  static void heap_set(uint32_t index, Timer *timer) {
+    timer_heap[index] = timer;
+    timer->heap_index = index;
+  }
+
+  static void heap_sift_up(uint32_t index) {
+    auto timer = timer_heap[index];
+
+    while(index > 0) {
+      auto parent = (index - 1) / 2;
+      if(!timer_before(timer, timer_heap[parent]))
+        break;
+
+      heap_set(index, timer_heap[parent]);
+      index = parent;
+    }
+
+    heap_set(index, timer);
+  }
+
+  static void heap_sift_down(uint32_t index) {
+    auto timer = timer_heap[index];
+    uint32_t size = timer_heap.size();
+
+    while(true) {
+      auto child = index * 2 + 1;
+      if(child >= size)
+        break;
+
+      if(child + 1 < size && timer_before(timer_heap[child + 1], timer_heap[child]))
+        child++;
+
+      if(!timer_before(timer_heap[child], timer))
+        break;
+
+      heap_set(index, timer_heap[child]);
+      index = child;
+    }
+
+    heap_set(index, timer);
+  }
+
+  static void schedule_timer(Timer *timer) {
+    timer->due = timer->started + timer->duration;
+    timer->order = next_timer_order++;
+
+    timer_heap.push_back(timer);
+    heap_sift_up(timer_heap.size() - 1);
+  }
+
+  static void unschedule_timer(Timer *timer) {
+    // also guards against copies of a scheduled timer
+    if(timer->heap_index < 0 || timer_heap[timer->heap_index] != timer)
+      return;
+
+    uint32_t index = timer->heap_index;
+    timer->heap_index = -1;
+
+    auto last = timer_heap.back();
+    timer_heap.pop_back();
+
+    if(last == timer)
+      return;
+
+    // move the last timer into the gap and restore the heap order
+    heap_set(index, last);
+    if(index > 0 && timer_before(last, timer_heap[(index - 1) / 2]))
+      heap_sift_up(index);
+    else
+      heap_sift_down(index);
+  }
 
   Timer::Timer() = default;
 
@@ -13,16 +96,11 @@ namespace blit {
   }
 
   Timer::~Timer() {
-    for(auto it = timers.begin(); it != timers.end(); ++it) {
-      if(*it == this) {
-        timers.erase(it);
-        break;
-      }
-    }
+    unschedule_timer(this);
   }
 
   /**
-   * Initialize the timer.
+   * Initialize the timer. If the timer is running the new duration applies to the current loop.
    *
    * @param callback Callback function to trigger when timer has elapsed.
    * @param duration Duration of the timer in milliseconds.
@@ -32,14 +110,19 @@ namespace blit {
     this->callback = callback;
     this->duration = duration;
     this->loops = loops;
+
+    // the due time is worked out when scheduling
+    if(state == RUNNING) {
+      unschedule_timer(this);
+      schedule_timer(this);
+    }
   }
 
   /**
    * Start the timer.
    */
   void Timer::start() {
-    if(state == UNINITIALISED)
-      timers.push_back(this);
+    unschedule_timer(this);
 
     if(state == PAUSED)
       started = blit::now() - (paused - started); // Modify start time based on when timer was paused.
@@ -49,6 +132,7 @@ namespace blit {
     }
 
     this->state = RUNNING;
+    schedule_timer(this);
   }
 
   /**
@@ -57,6 +141,8 @@ namespace blit {
   void Timer::pause() {
     if (state != RUNNING) return;
 
+    unschedule_timer(this);
+
     paused = blit::now();
     state = PAUSED;
   }
@@ -67,32 +153,55 @@ namespace blit {
   void Timer::stop() {
     if(state == UNINITIALISED) return;
 
+    unschedule_timer(this);
+
     this->state = STOPPED;
   }
 
   /**
    * Update all running timers, triggering any that have elapsed.
    *
+   * Only timers that are due are visited.
+   *
    * @param time Time in milliseconds.
    */
   void update_timers(uint32_t time) {
-    for (auto t: timers) {
-      if (t->state == Timer::RUNNING){
-        if (time > (t->started + t->duration)) { // timer triggered
-          if(t->loops == -1){
-            t->started = time; // reset the start time correcting for any error
-          }
-          else
-          {
-            t->loop_count++;
-            t->started = time;
-            if (t->loop_count == t->loops){
-              t->state = Timer::FINISHED;
-            }
-          }
-          t->callback(*t);
-        }
+    // timers rescheduled below are due after `time`, so each triggers at most once
+    while (!timer_heap.empty()) {
+      auto t = timer_heap[0];
+
+      if (int32_t(time - t->due) <= 0)
+        break;
+
+      unschedule_timer(t);
+
+      t->started = time; // reset the start time correcting for any error
+
+      if (t->loops != -1) {
+        t->loop_count++;
+        if (t->loop_count == t->loops)
+          t->state = Timer::FINISHED;
       }
+
+      if (t->state == Timer::RUNNING)
+        schedule_timer(t);
+
+      t->callback(*t);
+    }
+  }
+
+  /**
+   * Move all running timers forward, used to skip time where the game wasn't running.
+   *
+   * Paused timers don't need adjusting as only the time spent running counts.
+   *
+   * @param offset Time to skip in milliseconds.
+   */
+  void shift_timers(uint32_t offset) {
+    // all move by the same amount, so the heap order is unchanged
+    for (auto t : timer_heap) {
+      t->started += offset;
+      t->due += offset;
     }
   }
 }
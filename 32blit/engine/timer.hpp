@@ -10,7 +10,8 @@ namespace blit {
 
     TimerCallback callback = nullptr;
 
-    uint32_t duration = 0;                  // how many milliseconds between callbacks
+    uint32_t duration = 0;                  // how many milliseconds between callbacks, only read by init/start and
+                                            // when the timer loops, so writing it doesn't change the current loop
     uint32_t started = 0;                   // system time when timer started in milliseconds
     uint32_t paused = 0;                    // time when timer was paused
     int32_t loops = -1, loop_count = 0;     // number of times to repeat timer (-1 == forever)
@@ -36,7 +37,13 @@ namespace blit {
     Timer();
     Timer(TimerCallback callback, uint32_t duration, int32_t loops = -1);
     ~Timer();
+
+    // scheduler state, only valid while running
+    uint32_t due = 0;                       // time the timer triggers after
+    uint32_t order = 0;                     // start order, used to keep timers due at the same time in order
+    int32_t heap_index = -1;                // position in the scheduler heap, -1 if not scheduled
   };
 
   extern void update_timers(uint32_t time);
+  extern void shift_timers(uint32_t offset);
 }
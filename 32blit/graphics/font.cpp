@@ -1,8 +1,10 @@
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
 #include "font.hpp"
 
-static const uint8_t outline_font_data[96][6] = {
+static constexpr uint8_t outline_font_data[96][6] = {
   {0x00,0x00,0x00,0x00,0x00,0x00}, //  
   {0x7f,0x51,0x7f,0x00,0x00,0x00}, // !
   {0x0f,0x09,0x0f,0x09,0x0f,0x00}, // "
@@ -110,7 +112,7 @@ static const uint8_t outline_font_width[96] = {
   6, 6, 6, 6, 6, 6, 6, 7, 6, 6, 6, 6, 4, 6, 7, 2
 };
 
-static const uint8_t fat_font_data[96][6] = {
+static constexpr uint8_t fat_font_data[96][6] = {
   {0x00,0x00,0x00,0x00,0x00,0x00}, //  
   {0x5e,0x06,0x06,0x00,0x00,0x00}, // !
   {0x1e,0x00,0x00,0x1e,0x00,0x00}, // "
@@ -218,7 +220,7 @@ static const uint8_t fat_font_width[96] = {
   6, 7, 5, 5, 6, 6, 6, 7, 6, 6, 6, 5, 2, 4, 7, 2
 };
 
-static const uint8_t minimal_font_data[96][6] = {
+static constexpr uint8_t minimal_font_data[96][6] = {
   {0x00,0x00,0x00,0x00,0x00,0x00}, //  
   {0x2e,0x00,0x00,0x00,0x00,0x00}, // !
   {0x06,0x00,0x06,0x00,0x00,0x00}, // "
@@ -326,8 +328,70 @@ static const uint8_t minimal_font_width[96] = {
   6, 6, 6, 5, 6, 6, 6, 6, 5, 5, 5, 4, 2, 4, 4, 2
 };
 
+// transpose the column data into one byte per row (bit 0 is the leftmost pixel) for the text renderer
+template<std::size_t w>
+static constexpr std::array<uint8_t, 96 * 8> transpose_font(const uint8_t (&data)[96][w]) {
+  std::array<uint8_t, 96 * 8> rows{};
+
+  for(std::size_t c = 0; c < 96; c++) {
+    for(std::size_t y = 0; y < 8; y++) {
+      for(std::size_t x = 0; x < w; x++) {
+        if(data[c][x] & (1 << y))
+          rows[c * 8 + y] |= 1 << x;
+      }
+    }
+  }
+
+  return rows;
+}
+
+static constexpr auto outline_font_rows = transpose_font(outline_font_data);
+static constexpr auto fat_font_rows = transpose_font(fat_font_data);
+static constexpr auto minimal_font_rows = transpose_font(minimal_font_data);
+
+namespace blit {
+  const Font outline_font(&outline_font_data[0][0], outline_font_width, 6, 8, 1, outline_font_rows.data());
+  const Font fat_font(&fat_font_data[0][0], fat_font_width, 6, 8, 1, fat_font_rows.data());
+  const Font minimal_font(&minimal_font_data[0][0], minimal_font_width, 6, 8, 1, minimal_font_rows.data());
+}
+
 namespace blit {
-  const Font outline_font(&outline_font_data[0][0], outline_font_width, 6, 8);
-  const Font fat_font(&fat_font_data[0][0], fat_font_width, 6, 8);
-  const Font minimal_font(&minimal_font_data[0][0], minimal_font_width, 6, 8);
-}
\ No newline at end of file
+  static uint32_t read_code_point(const uint8_t *code_points, uint32_t index) {
+    auto p = code_points + index * 4;
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+  }
+
+  /**
+   * Find the character for a code point.
+   *
+   * \param code_point Unicode code point (or byte for fonts without a code point table)
+   * \return Index of the character, 0 if the font doesn't contain it
+   */
+  uint16_t Font::get_char_index(uint32_t code_point) const {
+    if(!code_points) {
+      uint8_t chr_idx = code_point & 0x7F;
+      return chr_idx < ' ' ? 0 : chr_idx - ' ';
+    }
+
+    // fonts usually start with a contiguous range, so try a direct lookup first
+    uint32_t first = read_code_point(code_points, 0);
+    if(code_point >= first && code_point - first < num_chars && read_code_point(code_points, code_point - first) == code_point)
+      return code_point - first;
+
+    int lo = 0, hi = num_chars - 1;
+    while(lo <= hi) {
+      int mid = (lo + hi) / 2;
+      uint32_t mid_code_point = read_code_point(code_points, mid);
+
+      if(mid_code_point == code_point)
+        return mid;
+
+      if(mid_code_point < code_point)
+        lo = mid + 1;
+      else
+        hi = mid - 1;
+    }
+
+    return 0;
+  }
+}
@@ -3,14 +3,47 @@
 #include <cstdint>
 
 namespace blit {
+  /**
+   * Bitmap font.
+   *
+   * Packed font assets start with an 8 byte header: 4 bytes of magic, number of characters, width,
+   * height and line spacing. This is followed by the character widths then the character data
+   * (1 bit per pixel, one or more bytes per column). These cover ASCII 32-127.
+   *
+   * Anti-aliased fonts use a different header (little endian):
+   *
+   *     0   "FNT2"
+   *     4   uint16  number of characters
+   *     6   uint8   width
+   *     7   uint8   height
+   *     8   uint8   line spacing
+   *     9   uint8   bits per pixel (1, 2 or 4)
+   *     10  uint16  reserved (0)
+   *     12  uint32  code point of each character, ascending
+   *         uint8   width of each character
+   *                 character data
+   *
+   * The character data is stored in rows of (width * bpp + 7) / 8 bytes, with the leftmost pixel in
+   * the lowest bits. Each pixel is the coverage of the pen, from 0 to (1 << bpp) - 1. Text drawn
+   * with these fonts is UTF-8.
+   */
   struct Font {
-    constexpr Font(const uint8_t *data, const uint8_t *char_w_variable, uint8_t char_w, uint8_t char_h, uint8_t spacing_y = 1)
-      : data(data), char_w(char_w), char_h(char_h), spacing_y(spacing_y), char_w_variable(char_w_variable) {}
+    constexpr Font(const uint8_t *data, const uint8_t *char_w_variable, uint8_t char_w, uint8_t char_h, uint8_t spacing_y = 1, const uint8_t *row_data = nullptr)
+      : data(data), char_w(char_w), char_h(char_h), spacing_y(spacing_y), char_w_variable(char_w_variable), row_data(row_data) {}
     
     /// Create a font from a packed font asset
-    constexpr Font(const uint8_t *data) : data(data + 8 + data[4]), char_w(data[5]), char_h(data[6]), spacing_y(data[7]), char_w_variable(data + 8) {}
+    constexpr Font(const uint8_t *data) :
+      data(is_packed_v2(data) ? nullptr : data + 8 + data[4]),
+      char_w(data[is_packed_v2(data) ? 6 : 5]), char_h(data[is_packed_v2(data) ? 7 : 6]), spacing_y(data[is_packed_v2(data) ? 8 : 7]),
+      char_w_variable(is_packed_v2(data) ? data + 12 + packed_v2_num_chars(data) * 4 : data + 8),
+      row_data(is_packed_v2(data) ? data + 12 + packed_v2_num_chars(data) * 5 : nullptr),
+      bpp(is_packed_v2(data) ? data[9] : 1),
+      num_chars(is_packed_v2(data) ? packed_v2_num_chars(data) : data[4]),
+      code_points(is_packed_v2(data) ? data + 12 : nullptr) {}
 
-    /// Character data (packed 1 bit per pixel)
+    uint16_t get_char_index(uint32_t code_point) const;
+
+    /// Character data (packed 1 bit per pixel, by column)
     const uint8_t *data;
 
     /// Fixed character size
@@ -21,6 +54,27 @@ namespace blit {
 
     /// Individual character widths
     const uint8_t *char_w_variable;
+
+    /// Optional character data by row ((char_w * bpp + 7) / 8 bytes per row, the leftmost pixel is in the lowest bits)
+    const uint8_t *row_data = nullptr;
+
+    /// Bits per pixel of the row data
+    uint8_t bpp = 1;
+
+    /// Number of characters
+    uint16_t num_chars = 96;
+
+    /// Optional table of code points for each character (uint32_t, little endian, ascending), ASCII 32-127 if not set
+    const uint8_t *code_points = nullptr;
+
+  private:
+    static constexpr bool is_packed_v2(const uint8_t *data) {
+      return data[0] == 'F' && data[1] == 'N' && data[2] == 'T' && data[3] == '2';
+    }
+
+    static constexpr uint16_t packed_v2_num_chars(const uint8_t *data) {
+      return data[4] | data[5] << 8;
+    }
   };
 
   extern const Font outline_font;
@@ -8,6 +8,7 @@
 #include "surface.hpp"
 
 #include "../engine/file.hpp"
+#include "../engine/profile_zone.hpp"
 
 using namespace blit;
 
@@ -317,6 +318,8 @@ namespace blit {
    * \param t
    */
   void Surface::blit(Surface *src, const Rect &sprite, const Point &p, int t) {
+    blit_profile_zone("Surface::blit");
+
     Rect dr = clip.intersection(Rect(p.x, p.y, sprite.w, sprite.h));  // clipped destination rect
 
     if (dr.empty())
@@ -453,6 +456,8 @@ namespace blit {
    * \param hflip `true` to flip the source surface horizontally
    */
   void Surface::blit(Surface *src, Rect r, Point p) {
+    blit_profile_zone("Surface::blit");
+
     Rect dr = clip.intersection(Rect(p.x, p.y, r.w, r.h));  // clipped destination rect
 
     if (dr.empty())
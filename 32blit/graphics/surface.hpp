@@ -185,8 +185,8 @@ namespace blit {
 
     void text(std::string_view message, const Font &font, const Rect &r, bool variable = true, TextAlign align = TextAlign::top_left);
     void text(std::string_view message, const Font &font, const Point &p, bool variable = true, TextAlign align = TextAlign::top_left);
-    Size measure_text(std::string_view message, const Font &font, bool variable = true);
-    std::string wrap_text(std::string_view message, int32_t width, const Font &font, bool variable = true, bool words = true);
+    static Size measure_text(std::string_view message, const Font &font, bool variable = true);
+    static std::string wrap_text(std::string_view message, int32_t width, const Font &font, bool variable = true, bool words = true);
 
     /*void outline_circle(const point &c, int32_t r);
 
@@ -1,15 +1,170 @@
 
+#include <algorithm>
 #include <string>
 
 #include "../types/point.hpp"
 #include "../types/rect.hpp"
 #include "font.hpp"
 #include "surface.hpp"
+#include "text_layout.hpp"
 
 using namespace blit;
 
 namespace blit {
 
+  static int get_row_bytes(const Font &font) {
+    return (font.char_w * font.bpp + 7) / 8;
+  }
+
+  static int get_glyph_size(const Font &font) {
+    if (font.row_data)
+      return get_row_bytes(font) * font.char_h;
+
+    return font.char_w * ((font.char_h + 7) / 8);
+  }
+
+  // draw a character with coverage values, as runs of pixels with the same coverage
+  static void draw_glyph_aa(Surface &dest, const Font &font, const uint8_t *glyph, const Point &c, int x0, int x1, int y0, int y1) {
+    const int row_bytes = get_row_bytes(font);
+    const int bpp = font.bpp;
+    const int max_coverage = (1 << bpp) - 1;
+
+    // pens for each coverage level
+    Pen pens[16];
+    for (int i = 1; i <= max_coverage; i++) {
+      pens[i] = dest.pen;
+      pens[i].a = dest.pen.a * i / max_coverage;
+    }
+
+    for (int y = y0; y < y1; y++) {
+      const uint8_t *row = glyph + y * row_bytes;
+      uint32_t po = dest.offset(c.x, c.y + y);
+
+      // unpack the visible part of the row
+      uint8_t coverage[256];
+      for (int x = x0, bit = x0 * bpp; x < x1; x++, bit += bpp)
+        coverage[x] = (row[bit >> 3] >> (bit & 7)) & max_coverage;
+
+      int x = x0;
+      while (x < x1) {
+        int cov = coverage[x];
+        if (!cov) {
+          x++;
+          continue;
+        }
+
+        int run_start = x++;
+        while (x < x1 && coverage[x] == cov)
+          x++;
+
+        dest.pbf(&pens[cov], &dest, po + run_start, x - run_start);
+      }
+    }
+  }
+
+  // draw a single character at c, clipped to the surface clip rect
+  static void draw_glyph(Surface &dest, const Font &font, uint16_t chr_idx, const Point &c) {
+    const int height_bytes = (font.char_h + 7) / 8;
+    const int row_bytes = get_row_bytes(font);
+    const int glyph_size = get_glyph_size(font);
+
+    // clip the character once, then draw each row as runs of lit pixels
+    int x0 = std::max(0, dest.clip.x - c.x), x1 = std::min(int(font.char_w), dest.clip.x + dest.clip.w - c.x);
+    int y0 = std::max(0, dest.clip.y - c.y), y1 = std::min(int(font.char_h), dest.clip.y + dest.clip.h - c.y);
+
+    if (x0 >= x1 || y0 >= y1)
+      return;
+
+    if (font.bpp > 1) {
+      draw_glyph_aa(dest, font, &font.row_data[chr_idx * glyph_size], c, x0, x1, y0, y1);
+      return;
+    }
+
+    const uint8_t* font_chr = font.row_data ? &font.row_data[chr_idx * glyph_size] : &font.data[chr_idx * glyph_size];
+
+    for (int y = y0; y < y1; y++) {
+      uint32_t po = dest.offset(c.x, c.y + y);
+
+      for (int chunk_x = x0; chunk_x < x1; chunk_x += 32) {
+        int chunk_w = std::min(32, x1 - chunk_x);
+        uint32_t bits = 0; // bit 0 is chunk_x
+
+        if (font.row_data && font.char_w <= 32) {
+          const uint8_t *row = font_chr + y * row_bytes;
+          uint32_t row_bits = 0;
+          for (int i = 0; i < row_bytes; i++)
+            row_bits |= uint32_t(row[i]) << (i * 8);
+
+          bits = row_bits >> chunk_x;
+        } else if (font.row_data) {
+          const uint8_t *row = font_chr + y * row_bytes;
+          for (int x = 0; x < chunk_w; x++) {
+            if (row[(chunk_x + x) >> 3] & (1 << ((chunk_x + x) & 7)))
+              bits |= 1u << x;
+          }
+        } else {
+          int bit = 1 << (y & 7);
+          for (int x = 0; x < chunk_w; x++) {
+            if (font_chr[(chunk_x + x) * height_bytes + y / 8] & bit)
+              bits |= 1u << x;
+          }
+        }
+
+        if (chunk_w < 32)
+          bits &= (1u << chunk_w) - 1;
+
+        int x = 0;
+        while (bits) {
+          // skip to the start of the run
+          while (!(bits & 1)) {
+            bits >>= 1;
+            x++;
+          }
+
+          int run_start = x;
+          while (bits & 1) {
+            bits >>= 1;
+            x++;
+          }
+
+          dest.pbf(&dest.pen, &dest, po + chunk_x + run_start, x - run_start);
+        }
+      }
+    }
+  }
+
+  static bool is_glyph_blank(const Font &font, uint16_t chr_idx) {
+    const int glyph_size = get_glyph_size(font);
+    const uint8_t* font_chr = font.row_data ? &font.row_data[chr_idx * glyph_size] : &font.data[chr_idx * glyph_size];
+
+    for (int i = 0; i < glyph_size; i++) {
+      if (font_chr[i])
+        return false;
+    }
+
+    return true;
+  }
+
+  // get the character at off and move past it, fonts with a code point table use UTF-8
+  static uint32_t next_char(const Font &font, std::string_view message, size_t &off) {
+    uint8_t b = message[off++];
+
+    if (!font.code_points || b < 0x80)
+      return b;
+
+    int len = b >= 0xF0 ? 3 : b >= 0xE0 ? 2 : b >= 0xC0 ? 1 : 0;
+    uint32_t code_point = b & (0x3F >> len);
+
+    for (; len && off < message.length() && (message[off] & 0xC0) == 0x80; len--)
+      code_point = code_point << 6 | (message[off++] & 0x3F);
+
+    // truncated or invalid, use the byte
+    if (len)
+      return b;
+
+    return code_point;
+  }
+
   /**
    * Draw text to surface using the specified font and the current pen.
    *
@@ -58,21 +213,15 @@ namespace blit {
         c.x += (r.w - bounds.w) / 2;
     }
 
-    const int height_bytes = (font.char_h + 7) / 8;
-    const int char_size = font.char_w * height_bytes;
-
     size_t char_off = 0;
 
-    for (char chr : message) {
+    while (char_off < message.length()) {
       // draw character
-
-      uint8_t chr_idx = chr & 0x7F;
-      chr_idx = chr_idx < ' ' ? 0 : chr_idx - ' ';
+      uint32_t chr = next_char(font, message, char_off);
+      uint16_t chr_idx = font.get_char_index(chr);
 
       uint8_t char_width = 0;
 
-      const uint8_t* font_chr = &font.data[chr_idx * char_size];
-
       // If this is a narrow character in fixed-width, center it in the render box
       if (!variable) {
         uint8_t fix_width = (font.char_w - font.char_w_variable[chr_idx]) / 2;
@@ -82,22 +231,7 @@ namespace blit {
         char_width = font.char_w_variable[chr_idx];
       }
 
-      for (uint8_t y = 0; y < font.char_h; y++) {
-        if (c.y + y < 0)
-          continue;
-
-        uint32_t po = offset(Point(c.x, c.y + y));
-
-        for (uint8_t x = 0; x < font.char_w; x++) {
-          int bit = 1 << (y & 7);
-          if (font_chr[x * height_bytes + y / 8] & bit) {
-            if(clip.contains(Point(c.x + x, c.y + y)))
-              pbf(&pen, this, po, 1);
-          }
-
-          po++;
-        }
-      }
+      draw_glyph(*this, font, chr_idx, c);
 
       // increment the cursor
       c.x += char_width;
@@ -107,11 +241,11 @@ namespace blit {
 
         // check horizontal alignment
         if ((align & 0b1100) != TextAlign::left) {
-          auto end = message.find_first_of('\n', char_off + 1);
+          auto end = message.find_first_of('\n', char_off);
           if(end != std::string::npos)
-            end -= char_off + 1;
+            end -= char_off;
 
-          Size bounds = measure_text(message.substr(char_off + 1, end), font, variable);
+          Size bounds = measure_text(message.substr(char_off, end), font, variable);
 
           if ((align & 0b1100) == TextAlign::right)
             c.x += r.w - bounds.w;
@@ -119,19 +253,14 @@ namespace blit {
             c.x += (r.w - bounds.w) / 2;
         }
       }
-
-      char_off++;
     }
   }
 
-  uint8_t get_char_width(const Font &font, char c, bool variable) {
+  uint8_t get_char_width(const Font &font, uint32_t c, bool variable) {
     if (!variable)
       return font.char_w;
 
-    uint8_t chr_idx = c & 0x7F;
-    chr_idx = chr_idx < ' ' ? 0 : chr_idx - ' ';
-
-    return font.char_w_variable[chr_idx];
+    return font.char_w_variable[font.get_char_index(c)];
   }
 
   /**
@@ -162,8 +291,10 @@ namespace blit {
         line_len = 0;
         char_off++;
       } else if (variable) {
-        line_len += get_char_width(font, message[char_off], true);
-        char_off++;
+        line_len += get_char_width(font, next_char(font, message, char_off), true);
+      } else if (font.code_points) {
+        line_len += font.char_w;
+        next_char(font, message, char_off);
       } else {
         // calculate a line at a time if using fixed-width characters
         size_t end = message.find_first_of('\n', char_off);
@@ -183,6 +314,137 @@ namespace blit {
 
     return bounds;
   }
+
+  /**
+   * Create a text layout.
+   *
+   * \param font Font to use
+   * \param variable Use variable character widths
+   * \param align Alignment of the text inside the layout size
+   * \param wrap Wrap text at word boundaries to fit the layout width
+   */
+  TextLayout::TextLayout(const Font &font, bool variable, TextAlign align, bool wrap) : font(&font), variable(variable), align(align), wrap(wrap) {
+  }
+
+  /**
+   * Set the text to lay out. The layout is only updated if the text has changed.
+   *
+   * \param text Text to lay out
+   * \return `true` if the text changed
+   */
+  bool TextLayout::set_text(std::string_view text) {
+    if(this->text == text)
+      return false;
+
+    this->text = text;
+    dirty = true;
+    return true;
+  }
+
+  /**
+   * Set the size to align the text in, and the width to wrap at if wrapping is enabled.
+   * The layout is only updated if the size has changed.
+   *
+   * \param size Size of the layout
+   * \return `true` if the size changed
+   */
+  bool TextLayout::set_size(const Size &size) {
+    if(this->size == size)
+      return false;
+
+    this->size = size;
+    dirty = true;
+    return true;
+  }
+
+  /**
+   * Get the measured size of the text, after wrapping.
+   *
+   * \return Size of the text
+   */
+  Size TextLayout::get_bounds() {
+    if(dirty)
+      layout();
+
+    return bounds;
+  }
+
+  /**
+   * Draw the text using the current pen of the destination surface.
+   *
+   * \param dest Surface to draw to
+   * \param p Top-left of the layout
+   */
+  void TextLayout::draw(Surface &dest, const Point &p) {
+    if(!dest.clip.intersects(Rect(p, size)))
+      return;
+
+    if(dirty)
+      layout();
+
+    for(auto &glyph : glyphs)
+      draw_glyph(dest, *font, glyph.index, Point(p.x + glyph.x, p.y + glyph.y));
+  }
+
+  // position each character the same way as Surface::text
+  void TextLayout::layout() {
+    std::string wrapped;
+    std::string_view message = text;
+
+    if(wrap && size.w > 0) {
+      wrapped = Surface::wrap_text(message, size.w, *font, variable);
+      message = wrapped;
+    }
+
+    bounds = Surface::measure_text(message, *font, variable);
+    glyphs.clear();
+
+    auto align_line = [this](std::string_view line) {
+      if((align & 0b1100) == TextAlign::left)
+        return 0;
+
+      int line_w = Surface::measure_text(line.substr(0, line.find_first_of('\n')), *font, variable).w;
+
+      if((align & 0b1100) == TextAlign::right)
+        return size.w - line_w;
+
+      return (size.w - line_w) / 2; // center
+    };
+
+    Point c(align_line(message), 0);
+
+    if((align & 0b11) == TextAlign::bottom)
+      c.y += size.h - bounds.h;
+    else if((align & 0b11) == TextAlign::center_v)
+      c.y += (size.h - bounds.h) / 2;
+
+    size_t char_off = 0;
+
+    while(char_off < message.length()) {
+      uint32_t chr = next_char(*font, message, char_off);
+      uint16_t chr_idx = font->get_char_index(chr);
+      uint8_t char_width;
+
+      if(!variable) {
+        uint8_t fix_width = (font->char_w - font->char_w_variable[chr_idx]) / 2;
+        c.x += fix_width;
+        char_width = font->char_w - fix_width;
+      } else
+        char_width = font->char_w_variable[chr_idx];
+
+      if(!is_glyph_blank(*font, chr_idx))
+        glyphs.push_back({int16_t(c.x), int16_t(c.y), chr_idx});
+
+      c.x += char_width;
+
+      if(chr == '\n') {
+        c.x = align_line(message.substr(char_off));
+        c.y += font->char_h + font->spacing_y;
+      }
+    }
+
+    dirty = false;
+  }
 }
 
 /**
@@ -215,15 +477,26 @@ std::string Surface::wrap_text(std::string_view message, int32_t width, const Fo
       continue;
     }
 
-    int char_width = get_char_width(font, message[i], variable);
+    // the width of a multi-byte character is added at its first byte
+    if (font.code_points && (message[i] & 0xC0) == 0x80)
+      continue;
+
+    size_t next_off = i;
+    int char_width = get_char_width(font, next_char(font, message, next_off), variable);
     current_x += char_width;
 
     if (current_x > width) {
       if(!words || last_space == std::string::npos) {
-        // no space to break at or we're not breaking on words
-        ret += message.substr(copied_off, i - copied_off - 1);
+        // no space to break at or we're not breaking on words, move the previous character to the next line too
+        size_t prev = i > copied_off ? i - 1 : i;
+
+        // don't split a multi-byte character
+        while (font.code_points && prev > copied_off && (message[prev] & 0xC0) == 0x80)
+          prev--;
+
+        ret += message.substr(copied_off, prev - copied_off);
         ret += "\n";
-        copied_off = i - 1;
+        copied_off = prev;
         current_x = char_width;
       } else {
         // break at last space
@@ -231,7 +504,7 @@ std::string Surface::wrap_text(std::string_view message, int32_t width, const Fo
         ret += "\n";
         copied_off = last_space + 1; // don't copy the space
         last_space = std::string::npos;
-        current_x = measure_text(message.substr(copied_off, i - copied_off + 1), font, variable).w;
+        current_x = measure_text(message.substr(copied_off, next_off - copied_off), font, variable).w;
       }
     }
   }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "font.hpp"
+#include "surface.hpp"
+#include "../types/point.hpp"
+#include "../types/size.hpp"
+
+namespace blit {
+
+  /**
+   * Text that is measured, wrapped and positioned once, then drawn until it changes.
+   *
+   * Draws the same as `Surface::text` with the same font, alignment and size.
+   */
+  class TextLayout {
+  public:
+    TextLayout(const Font &font, bool variable = true, TextAlign align = TextAlign::top_left, bool wrap = false);
+
+    bool set_text(std::string_view text);
+    bool set_size(const Size &size);
+
+    const std::string &get_text() const {return text;}
+    const Size &get_size() const {return size;}
+    Size get_bounds();
+
+    void draw(Surface &dest, const Point &p);
+
+  private:
+    struct Glyph {
+      int16_t x, y;
+      uint16_t index;
+    };
+
+    void layout();
+
+    const Font *font;
+    bool variable;
+    TextAlign align;
+    bool wrap;
+
+    std::string text;
+    Size size;
+
+    bool dirty = true;
+    Size bounds;
+    std::vector<Glyph> glyphs;
+  };
+}
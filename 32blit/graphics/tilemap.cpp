@@ -2,6 +2,7 @@
 */
 #include <cstring>
 #include "tilemap.hpp"
+#include "../engine/profile_zone.hpp"
 
 namespace blit {
 
@@ -129,6 +130,8 @@ namespace blit {
    * \param[in] scanline_callback Functon called on every scanline, accepts the scanline y position, should return a transformation matrix.
    */
   void TileMap::draw(Surface *dest, Rect viewport, std::function<Mat3(uint8_t)> scanline_callback) {
+    blit_profile_zone("TileMap::draw");
+
     //bool not_scaled = (from.w - to.w) | (from.h - to.h);
 
     viewport = dest->clip.intersection(viewport);
@@ -25,6 +25,10 @@
       Calling channels[n].trigger_attack() will run the playback and callback continuously until
       either channels[n].trigger_release() or channels[n].off() is called.
 
+      For sound effects that are already in memory, channels[n].play_sample() plays the data
+      directly (8/16-bit PCM or IMA ADPCM) without a callback, and can change the pitch.
+      This is shown on channel 1 with the B button.
+
 
 */
 
@@ -93,6 +97,7 @@ void render(uint32_t time_ms) {
 
   screen.pen = Pen(64, 64, 64);
 	screen.text("Press A to break screen.", minimal_font, Point(20, 60));
+	screen.text("Press B to break it at a random pitch.", minimal_font, Point(20, 70));
 }
 
 void update(uint32_t time_ms) {
@@ -104,5 +109,11 @@ void update(uint32_t time_ms) {
     wav_size = glass_wav_length;      // Set the array length to the value in assets.hpp
     channels[0].trigger_attack(); // Start the playback.
   }
+
+  if(buttons.pressed & Button::B) {
+    // Unsigned 8-bit data, played straight from the asset at 0.5-1.5x speed
+    Sample sample(glass_wav, glass_wav_length, SampleFormat::PCM8, 11025 + blit::random() % 22050);
+    channels[1].play_sample(sample);
+  }
 }
 
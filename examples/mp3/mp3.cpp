@@ -21,7 +21,7 @@ void init() {
   File::add_buffer_file("example.mp3", asset_mp3, asset_mp3_length);
 
   // Pass false for do_duration_calc if you don't need the duration.
-  // (it requires decoding the entire file, which takes a while if reading from the SD card)
+  // (if the file has no Xing/VBRI header it requires reading the entire file, which takes a while from the SD card)
   stream.load("example.mp3", true);
 
   // Any channel can be used here, the others are free for other sounds.
@@ -69,5 +69,14 @@ void update(uint32_t time) {
   if(buttons.released & Button::X)
     stream.restart();
 
+  // skip back/forward 5 seconds
+  if(buttons.released & Button::DPAD_LEFT) {
+    unsigned int sample = stream.get_current_sample();
+    stream.seek(sample > 22050 * 5 ? sample - 22050 * 5 : 0);
+  }
+
+  if(buttons.released & Button::DPAD_RIGHT)
+    stream.seek(stream.get_current_sample() + 22050 * 5);
+
   stream.update();
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <deque>
 
@@ -12,7 +13,18 @@ unsigned sent_count = 0;
 unsigned recv_count = 0;
 static constexpr int max_messages = 9;
 
+// a dot for each player, moved with the d-pad and kept in sync with rollback
+struct DotState {
+  Point pos[2];
+};
+
+DotState dots;
+RollbackSession rollback(sizeof(DotState), 8, 1);
+
 void on_message(const uint8_t *data, uint16_t len) {
+  if (rollback.message_received(data, len))
+    return;
+
   if (messages.size() >= max_messages) {
     messages.pop_front();
   }
@@ -24,6 +36,24 @@ void on_message(const uint8_t *data, uint16_t len) {
 void init() {
   message_received = on_message;
   enable_multiplayer();
+
+  dots.pos[0] = Point(100, 150);
+  dots.pos[1] = Point(220, 150);
+
+  rollback.save_state = [](uint8_t *data) { memcpy(data, &dots, sizeof(dots)); };
+  rollback.load_state = [](const uint8_t *data) { memcpy(&dots, data, sizeof(dots)); };
+  rollback.simulate = [](const uint32_t *inputs) {
+    for (int i = 0; i < 2; i++) {
+      auto &pos = dots.pos[i];
+      if (inputs[i] & Button::DPAD_LEFT) pos.x--;
+      if (inputs[i] & Button::DPAD_RIGHT) pos.x++;
+      if (inputs[i] & Button::DPAD_UP) pos.y--;
+      if (inputs[i] & Button::DPAD_DOWN) pos.y++;
+
+      pos.x = std::max(0, std::min(pos.x, screen.bounds.w - 4));
+      pos.y = std::max(14, std::min(pos.y, screen.bounds.h - 12));
+    }
+  };
 }
 
 void render(uint32_t time_ms) {
@@ -46,6 +76,18 @@ void render(uint32_t time_ms) {
   snprintf(counts, 50, "Sent: %u, Recv: %u", sent_count, recv_count);
   screen.text(counts, minimal_font, Point(screen.bounds.w/2, screen.bounds.h-2), true, TextAlign::bottom_center);
 
+  if (rollback.is_running()) {
+    for (int i = 0; i < 2; i++) {
+      screen.pen = i == rollback.get_local_player() ? Pen(0, 255, 0) : Pen(255, 0, 0);
+      screen.rectangle(Rect(dots.pos[i], Size(4, 4)));
+    }
+
+    auto &stats = rollback.get_stats();
+    snprintf(counts, 50, "Rollbacks: %u, max %u", unsigned(stats.rollbacks), unsigned(stats.max_depth));
+    screen.pen = Pen(64, 64, 64);
+    screen.text(counts, minimal_font, Point(screen.bounds.w / 2, screen.bounds.h - 11), true, TextAlign::bottom_center);
+  }
+
   screen.pen = Pen(96, 96, 96);
   int y = 28 + ((9-(int)messages.size()) * max_messages);
   for(auto &msg : messages) {
@@ -61,4 +103,6 @@ void update(uint32_t time_ms) {
     send_message((uint8_t *) message, (uint16_t)strlen(message));
     sent_count++;
   }
+
+  rollback.update(buttons & (Button::DPAD_LEFT | Button::DPAD_RIGHT | Button::DPAD_UP | Button::DPAD_DOWN));
 }
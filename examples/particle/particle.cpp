@@ -22,30 +22,21 @@ struct test_particle {
 };
 
 
-struct smoke_particle : Particle {
-  float age_boost;
-
-  smoke_particle(Vec2 pos, Vec2 vel, float age_boost) : Particle(pos, vel), age_boost(age_boost) {};
-};
-
-Particle* generate_smoke() {
-  return new smoke_particle(
-    Vec2((rand() % 20) - 10, (rand() % 20) - 10),
-    Vec2(((rand() % 40) - 20) / 2, (rand() % 20) - 60),
-    (rand() % 3000) / 3000.0f
-  );
+void generate_smoke(Vec2 &pos, Vec2 &vel, float &age_boost) {
+  pos = Vec2((rand() % 20) - 10, (rand() % 20) - 10);
+  vel = Vec2(((rand() % 40) - 20) / 2, (rand() % 20) - 60);
+  age_boost = (rand() % 3000) / 3000.0f;
 }
 
-ParticleGenerator smoke_generator(150, 4000, generate_smoke);
+ParticleSystem smoke_system(150, 4000, generate_smoke, 150 * 1000 / 4000);
 
 void render_smoke() {
-  for (auto p : smoke_generator.particles) {
-    smoke_particle *sp = static_cast<smoke_particle*>(p);
-    float age = sp->age + sp->age_boost;
+  for (uint32_t i = 0; i < smoke_system.size(); i++) {
+    float age = smoke_system.age(i) + smoke_system.user[i];
     int alpha = (255 - (age * 75.0f)) / 8.0f;
     int radius = (age * 150.0f) / 16.0f;
     screen.pen = Pen(255, 255, 255, alpha);
-    screen.circle(p->pos + Point(50, 240), radius);
+    screen.circle(smoke_system.pos(i) + Point(50, 240), radius);
   }
 }
 
@@ -202,24 +193,23 @@ void rain(uint32_t time_ms) {
 
 
 
-Particle* generate_basic_rain() {
-  return new Particle(
-    Vec2((std::rand() % 120) + 100, 0),
-    Vec2(0, 100)
-  );
+void generate_basic_rain(Vec2 &pos, Vec2 &vel, float &) {
+  pos = Vec2((std::rand() % 120) + 100, 0);
+  vel = Vec2(0, 100);
 }
 
-ParticleGenerator basic_rain_generator(250, 4000, generate_basic_rain);
+ParticleSystem basic_rain_system(250, 4000, generate_basic_rain, 250 * 1000 / 4000);
 
 void render_basic_rain() {
-  for (auto p : basic_rain_generator.particles) {
-    Particle *sp = static_cast<Particle*>(p);
-    if (sp->pos.y >= 239) {
-      sp->pos.y = 239;
+  // stop at the bottom of the screen
+  for (uint32_t i = 0; i < basic_rain_system.size(); i++) {
+    if (basic_rain_system.pos_y[i] >= 239) {
+      basic_rain_system.pos_y[i] = 239;
     }
-    screen.pen = Pen(128, 128, 255);
-    screen.pixel(sp->pos);
   }
+
+  static const Pen ramp[]{Pen(128, 128, 255), Pen(96, 96, 224), Pen(64, 64, 192)};
+  basic_rain_system.render(screen, Point(0, 0), ramp, 3);
 }
 
 void render(uint32_t time_ms) {
@@ -266,8 +256,8 @@ void render(uint32_t time_ms) {
 }
 
 void update(uint32_t time_ms) {
-//  smoke_generator.update(time_ms);
-  basic_rain_generator.update(time_ms);
+//  smoke_system.update(time_ms);
+  basic_rain_system.update(time_ms);
 
   if (pressed(Button::DPAD_LEFT)) {
     g.rotate(0.1f);
@@ -11,6 +11,8 @@
 // DOWN				Increase rows displayed on page
 // LEFT				Back Page
 // RIGHT			Next Page
+// JOYSTICK		Save a timeline of the last few seconds of probes to profiler-trace.json
+//						(open in chrome://tracing or ui.perfetto.dev)
 
 
 #include "profiler-test.hpp"
@@ -75,6 +77,9 @@ void init()
 	g_pCircleProbe 	= g_profiler.add_probe("Circle", 300);
 	g_pUpdateProbe 	= g_profiler.add_probe("Update");
 
+	// record probe start/end times for saving as a timeline
+	g_profiler.enable_trace(4096);
+
 	// enable metrics
 	SetupMetrics();
 }
@@ -98,6 +103,7 @@ void render(uint32_t time)
 	bool button_left = buttons.pressed & Button::DPAD_LEFT;
 	bool button_right = buttons.pressed & Button::DPAD_RIGHT;
 	bool button_home = buttons.pressed & Button::HOME;
+	bool button_joystick = buttons.pressed & Button::JOYSTICK;
 
 	if(button_up && (g_uRows>1))
 	{
@@ -155,6 +161,13 @@ void render(uint32_t time)
 		g_profiler.log_probes();
 	}
 
+	if(button_joystick)
+	{
+		// Save the trace
+		if(g_profiler.get_trace()->save("profiler-trace.json"))
+			debugf("Saved profiler-trace.json\n");
+	}
+
 	g_pRenderProbe->start();
 
 	// clear screen
@@ -3,6 +3,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <list>
+#include <map>
 
 #include "launcher.hpp"
 #include "assets.hpp"
@@ -17,6 +18,8 @@
 #include "theme.hpp"
 
 #include "credits.hpp"
+#include "metadata_cache.hpp"
+#include "preview_cache.hpp"
 
 using namespace blit;
 
@@ -45,10 +48,24 @@ static std::vector<GameInfo> game_list;
 static std::list<DirectoryInfo> directory_list;
 static std::list<DirectoryInfo>::iterator current_directory;
 
+// files that still need their metadata reading, done a few each update
+struct PendingMetadata {
+  size_t game_index;
+  std::string filename; // the .blit or .blmeta
+  uint32_t size;
+};
+
+static std::vector<PendingMetadata> pending_metadata;
+static size_t pending_metadata_pos = 0;
+static std::string pending_directory;
+
+static const uint32_t metadata_slice_us = 4000;
+
 static SortBy file_sort = SortBy::name;
 
 static GameInfo selected_game;
-static BlitGameMetadata selected_game_metadata;
+static const BlitGameMetadata no_metadata;
+static const BlitGameMetadata *selected_game_metadata = &no_metadata;
 
 static Surface *spritesheet;
 static Surface *screenshot;
@@ -58,10 +75,6 @@ static AutoRepeat ar_button_down(250, 600);
 static AutoRepeat ar_button_left(0, 0);
 static AutoRepeat ar_button_right(0, 0);
 
-#ifndef PICO_BUILD
-static uint8_t screenshot_buf[320 * 240 * 3];
-#endif
-
 static int calc_num_blocks(uint32_t size) {
   return (size - 1) / qspi_flash_sector_size + 1;
 }
@@ -142,9 +155,69 @@ static void sort_file_list() {
     }
 }
 
+// sort once all the titles are known, keeping the same file selected
+static void finish_file_list() {
+  std::string selected_filename;
+  if(selected_menu_item < (int)game_list.size())
+    selected_filename = game_list[selected_menu_item].filename;
+
+  sort_file_list();
+
+  for(auto it = game_list.begin(); it != game_list.end(); ++it) {
+    if(it->filename == selected_filename) {
+      selected_menu_item = it - game_list.begin();
+      break;
+    }
+  }
+
+  metadata_cache::end_directory(pending_directory);
+  metadata_cache::save();
+
+  pending_metadata.clear();
+  pending_metadata_pos = 0;
+}
+
+// read the metadata for as many files as fit in the time slice, at least one per call
+static void load_pending_metadata() {
+  if(pending_metadata_pos == pending_metadata.size())
+    return;
+
+  auto start = now_us();
+
+  do {
+    auto &pending = pending_metadata[pending_metadata_pos++];
+    auto &game = game_list[pending.game_index];
+
+    BlitGameMetadata meta;
+    if(parse_file_metadata(pending.filename, meta)) {
+      game.title = meta.title;
+      metadata_cache::store(pending.filename, pending.size, meta.title);
+    } else
+      metadata_cache::store(pending.filename, pending.size, "");
+
+    if(game.filename == selected_game.filename)
+      selected_game.title = game.title;
+
+  } while(pending_metadata_pos < pending_metadata.size() && us_diff(start, now_us()) < metadata_slice_us);
+
+  if(pending_metadata_pos == pending_metadata.size())
+    finish_file_list();
+}
+
+// use the cached title if the file hasn't changed, otherwise queue it to be read
+static void find_title(GameInfo &game, const std::string &meta_filename, uint32_t meta_size) {
+  if(!metadata_cache::find(meta_filename, meta_size, game.title))
+    pending_metadata.push_back({game_list.size(), meta_filename, meta_size});
+}
+
 static void load_file_list(const std::string &directory) {
 
   game_list.clear();
+  pending_metadata.clear();
+  pending_metadata_pos = 0;
+  pending_directory = directory;
+
+  metadata_cache::begin_directory(directory);
 
   auto files = list_files(directory, [](auto &file) {
     if(file.flags & FileFlags::directory)
@@ -164,6 +237,14 @@ static void load_file_list(const std::string &directory) {
 
   game_list.reserve(files.size()); // worst case
 
+  // metadata files, so that we only try to open the ones that exist
+  std::map<std::string, uint32_t> meta_files;
+
+  for(auto &file : files) {
+    if(file.name.length() > 7 && file.name.compare(file.name.length() - 7, 7, ".blmeta") == 0)
+      meta_files[file.name] = file.size;
+  }
+
   for(auto &file : files) {
     auto last_dot = file.name.find_last_of('.');
 
@@ -180,10 +261,7 @@ static void load_file_list(const std::string &directory) {
       game.size = file.size;
 
       // check for metadata
-      BlitGameMetadata meta;
-      if(parse_file_metadata(game.filename, meta)) {
-        game.title = meta.title;
-      }
+      find_title(game, game.filename, game.size);
 
       game_list.push_back(game);
       continue;
@@ -215,14 +293,12 @@ static void load_file_list(const std::string &directory) {
       game.ext[4] = 0;
       game.size = file.size;
       game.can_launch = true;
+      game.title = file.name;
 
       // check for a metadata file (fall back to handler's metadata)
-      BlitGameMetadata meta;
-      auto meta_filename = game.filename + ".blmeta";
-      if(parse_file_metadata(meta_filename, meta))
-        game.title = meta.title;
-      else
-        game.title = file.name;
+      auto meta_file = meta_files.find(file.name + ".blmeta");
+      if(meta_file != meta_files.end())
+        find_title(game, game.filename + ".blmeta", meta_file->second);
 
       game_list.push_back(game);
     }
@@ -235,7 +311,9 @@ static void load_file_list(const std::string &directory) {
   // probably doesn't do anything...
   game_list.shrink_to_fit();
 
-  sort_file_list();
+  // everything was cached
+  if(pending_metadata.empty())
+    finish_file_list();
 }
 
 static void load_directory_list(const std::string &directory) {
@@ -269,59 +347,109 @@ static void load_directory_list(const std::string &directory) {
   }
 }
 
-static void load_current_game_metadata() {
-  bool loaded = false;
-
-  if(!game_list.empty()) {
-    selected_game = game_list[selected_menu_item];
-
-    if(selected_game.type == GameType::file) {
-      // not a .blit - look for a metadata file
-      auto meta_filename = selected_game.filename + ".blmeta";
-      if(!parse_file_metadata(meta_filename, selected_game_metadata, true)) {
-        // fallback to handler metadata/placeholders
-        auto handler_meta = (char *)api.get_type_handler_metadata(selected_game.ext);
-        auto len = *reinterpret_cast<uint16_t *>(handler_meta + 8);
-        parse_metadata(handler_meta + 10, len, selected_game_metadata, true);
-
-        selected_game_metadata.description = "Launches with: " + selected_game_metadata.title;
-        selected_game_metadata.title = selected_game.title;
-        selected_game_metadata.author = "";
-        selected_game_metadata.version = "";
-      }
-      loaded = true;
-    } else
-      loaded = parse_file_metadata(selected_game.filename, selected_game_metadata, true);
+// decode the metadata images or screenshot for a file, called by the preview cache
+static void load_preview(const GameInfo &game, preview_cache::Preview &preview) {
+  auto &metadata = preview.metadata;
+
+  if(game.type == GameType::file) {
+    // not a .blit - look for a metadata file
+    auto meta_filename = game.filename + ".blmeta";
+    if(!parse_file_metadata(meta_filename, metadata, true)) {
+      // fallback to handler metadata/placeholders
+      auto handler_meta = (char *)api.get_type_handler_metadata(game.ext);
+      auto len = *reinterpret_cast<uint16_t *>(handler_meta + 8);
+      parse_metadata(handler_meta + 10, len, metadata, true);
+
+      metadata.description = "Launches with: " + metadata.title;
+      metadata.title = game.title;
+      metadata.author = "";
+      metadata.version = "";
+    }
+  } else if(!parse_file_metadata(game.filename, metadata, true)) {
+    // no valid metadata, reset
+    metadata.free_surfaces();
+    metadata = BlitGameMetadata();
   }
 
 #ifndef PICO_BUILD
-  if(selected_game.type == GameType::screenshot) {
-    // Free any old buffers
-    if(screenshot) {
-      delete[] screenshot->palette;
-      delete screenshot;
-      screenshot = nullptr;
-    }
-    // Load the new screenshot
-    screenshot = Surface::load(selected_game.filename, screenshot_buf, sizeof(screenshot_buf));
-  } else {
-    // Not showing a screenshot, free the buffers
-    if(screenshot) {
-      delete[] screenshot->palette;
-      delete screenshot;
-      screenshot = nullptr;
-    }
+  if(game.type == GameType::screenshot)
+    preview.screenshot = Surface::load(game.filename);
+#endif
+}
+
+// memory a preview will need, read from the image header for screenshots
+static uint32_t expected_preview_size(const GameInfo &game) {
+#ifndef PICO_BUILD
+  if(game.type != GameType::screenshot)
+    return 0;
+
+  File file;
+  uint8_t head[30]; // enough for either header
+
+  if(!file.open(game.filename, OpenMode::read) || file.read(0, sizeof(head), (char *)head) != sizeof(head))
+    return 0;
+
+  auto read16 = [&head](int off) {return uint32_t(head[off] | head[off + 1] << 8);};
+
+  if(head[0] == 'B' && head[1] == 'M') {
+    int32_t w = read16(18) | read16(20) << 16, h = read16(22) | read16(24) << 16;
+    auto bpp = read16(28);
+
+    return std::abs(w) * std::abs(h) * (bpp / 8) + (bpp == 8 ? 256 * sizeof(Pen) : 0);
   }
+
+  packed_image image;
+  memcpy(&image, head, sizeof(image));
+
+  if(image.format > uint8_t(PixelFormat::BGR555))
+    return 0;
+
+  bool is_raw = image.type[6] == 'R' && image.type[7] == 'W';
+  bool has_palette = image.format == uint8_t(PixelFormat::P) || !is_raw;
+
+  return image.width * image.height * pixel_format_stride[image.format] + (has_palette ? 256 * sizeof(Pen) : 0);
+#else
+  return 0;
 #endif
+}
 
-  // no valid metadata, reset
-  if(!loaded) {
-    selected_game_metadata.free_surfaces();
-    selected_game_metadata = BlitGameMetadata();
+static void load_current_game_metadata() {
+  if(game_list.empty()) {
+    selected_game_metadata = &no_metadata;
+    screenshot = nullptr;
+    return;
+  }
+
+  selected_game = game_list[selected_menu_item];
+
+  auto &preview = preview_cache::get(selected_game.filename, [game = selected_game](auto &preview) {
+    load_preview(game, preview);
+  }, expected_preview_size(selected_game));
+
+  selected_game_metadata = &preview.metadata;
+  screenshot = preview.screenshot;
+
+  // load the neighbours in the background so that scrolling doesn't wait for them
+  preview_cache::clear_prefetch();
+
+  int total_items = (int)game_list.size();
+
+  for(int offset : {1, -1, 2, -2}) {
+    int i = (selected_menu_item + offset + total_items * 2) % total_items;
+    if(i == selected_menu_item)
+      continue;
+
+    auto &game = game_list[i];
+    preview_cache::prefetch(game.filename, [game](auto &preview) {
+      load_preview(game, preview);
+    }, expected_preview_size(game));
   }
 }
 
 static bool launch_current_game() {
+  // keep anything read so far
+  metadata_cache::save();
+
   // save last file launched
   PathSave save{};
   strncpy(save.last_path, selected_game.filename.c_str(), sizeof(save.last_path) - 1);
@@ -340,6 +468,7 @@ static void delete_current_game() {
         api.erase_game(std::stoi(selected_game.filename.substr(7)) * qspi_flash_sector_size);
 
       ::remove_file(selected_game.filename);
+      preview_cache::remove(selected_game.filename);
 
       load_file_list(current_directory->name);
       load_current_game_metadata();
@@ -348,6 +477,8 @@ static void delete_current_game() {
 }
 
 static void init_lists() {
+  preview_cache::clear();
+
   load_directory_list("/");
   current_directory = directory_list.begin();
 
@@ -382,6 +513,7 @@ void init() {
   spritesheet = Surface::load(sprites);
 
   scan_flash();
+  metadata_cache::load();
   init_lists();
 
   // restore previously selected file
@@ -561,11 +693,11 @@ static void render_game_info() {
   screen.sprite(0, Point(game_actions_offset.x + 10, game_actions_offset.y + 12), SpriteTransform::R90);
 
   // game info
-  if(selected_game_metadata.splash)
-    screen.blit(selected_game_metadata.splash, Rect(Point(0, 0), selected_game_metadata.splash->bounds), game_info_offset);
+  if(selected_game_metadata->splash)
+    screen.blit(selected_game_metadata->splash, Rect(Point(0, 0), selected_game_metadata->splash->bounds), game_info_offset);
 
   screen.pen = theme.color_accent;
-  std::string wrapped_title = screen.wrap_text(selected_game_metadata.title, screen.bounds.w - game_info_offset.x - 10, launcher_font);
+  std::string wrapped_title = screen.wrap_text(selected_game_metadata->title, screen.bounds.w - game_info_offset.x - 10, launcher_font);
 
   Size title_size = screen.measure_text(wrapped_title, launcher_font);
   screen.text(wrapped_title, launcher_font, Point(game_info_offset.x, game_info_offset.y + 104));
@@ -573,11 +705,11 @@ static void render_game_info() {
   Rect desc_rect(game_info_offset.x, game_info_offset.y + 108 + title_size.h, screen.bounds.w - game_info_offset.x - 10, 64);
 
   screen.pen = theme.color_text;
-  std::string wrapped_desc = screen.wrap_text(selected_game_metadata.description, desc_rect.w, launcher_font);
+  std::string wrapped_desc = screen.wrap_text(selected_game_metadata->description, desc_rect.w, launcher_font);
   screen.text(wrapped_desc, launcher_font, desc_rect);
 
-  screen.text(selected_game_metadata.author, minimal_font, Point(game_info_offset.x, screen.bounds.h - 32));
-  screen.text(selected_game_metadata.version, minimal_font, Point(game_info_offset.x, screen.bounds.h - 24));
+  screen.text(selected_game_metadata->author, minimal_font, Point(game_info_offset.x, screen.bounds.h - 32));
+  screen.text(selected_game_metadata->version, minimal_font, Point(game_info_offset.x, screen.bounds.h - 24));
 
   int num_blocks = calc_num_blocks(selected_game.size);
   char buf[20];
@@ -658,10 +790,18 @@ void render(uint32_t time) {
 void update(uint32_t time) {
 
   if(blit::is_storage_available() != sd_detected) {
-    init_lists();
     sd_detected = blit::is_storage_available();
+
+    // the index is on the SD card, load it before the new lists save over it
+    if(sd_detected)
+      metadata_cache::load();
+
+    init_lists();
   }
 
+  load_pending_metadata();
+  preview_cache::update();
+
   bool button_a = buttons.released & Button::A;
   bool button_b = buttons.pressed & Button::B;
   bool button_x = buttons.pressed & Button::X;
@@ -744,10 +884,12 @@ void update(uint32_t time) {
       old_menu_item = -1;
     }
 
-    // toggle sort mode
+    // toggle sort mode (the list is sorted when it finishes loading)
     if (button_y) {
       file_sort = file_sort == SortBy::name ? SortBy::size : SortBy::name;
-      sort_file_list();
+
+      if(pending_metadata.empty())
+        sort_file_list();
     }
   }
 
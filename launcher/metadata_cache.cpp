@@ -0,0 +1,161 @@
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "metadata_cache.hpp"
+
+#include "32blit.hpp"
+#include "engine/api_private.hpp"
+
+using namespace blit;
+
+namespace metadata_cache {
+  struct Entry {
+    uint32_t size;
+    std::string title; // empty if the file has no metadata
+    bool seen;
+  };
+
+  // "BLMC", version, entry count, then for each entry:
+  // size, path length, path, title length, title
+  static const char magic[4]{'B', 'L', 'M', 'C'};
+  static const uint16_t version = 1;
+
+  static std::map<std::string, Entry> entries;
+  static bool dirty = false;
+
+  static std::string cache_path() {
+    return std::string(api.get_save_path()) + "metadata-cache";
+  }
+
+  // flash games are in memory, so reading them is already fast
+  static bool is_cached_path(const std::string &filename) {
+    return filename.compare(0, 6, "flash:") != 0;
+  }
+
+  static std::string parent_directory(const std::string &filename) {
+    auto slash = filename.find_last_of('/');
+    return slash == std::string::npos ? "/" : filename.substr(0, slash);
+  }
+
+  void load() {
+    entries.clear();
+    dirty = false;
+
+    File file(cache_path());
+    if(!file.is_open())
+      return;
+
+    auto length = file.get_length();
+    std::vector<uint8_t> buf(length);
+
+    if(length < 10 || file.read(0, length, (char *)buf.data()) != int32_t(length))
+      return;
+
+    auto read16 = [](const uint8_t *p) {return uint16_t(p[0] | p[1] << 8);};
+    auto read32 = [](const uint8_t *p) {return uint32_t(p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24);};
+
+    if(memcmp(buf.data(), magic, 4) != 0 || read16(buf.data() + 4) != version)
+      return;
+
+    auto count = read32(buf.data() + 6);
+    auto ptr = buf.data() + 10, end = buf.data() + length;
+
+    for(uint32_t i = 0; i < count; i++) {
+      if(end - ptr < 6)
+        break;
+
+      auto size = read32(ptr);
+      auto path_len = read16(ptr + 4);
+      ptr += 6;
+
+      if(end - ptr < path_len + 2)
+        break;
+
+      std::string path((const char *)ptr, path_len);
+      auto title_len = read16(ptr + path_len);
+      ptr += path_len + 2;
+
+      if(end - ptr < title_len)
+        break;
+
+      entries[path] = {size, std::string((const char *)ptr, title_len), false};
+      ptr += title_len;
+    }
+  }
+
+  void save() {
+    if(!dirty)
+      return;
+
+    std::vector<uint8_t> buf;
+
+    auto write16 = [&buf](uint16_t v) {
+      buf.push_back(v);
+      buf.push_back(v >> 8);
+    };
+
+    auto write32 = [&buf](uint32_t v) {
+      for(int i = 0; i < 4; i++)
+        buf.push_back(v >> (i * 8));
+    };
+
+    buf.insert(buf.end(), magic, magic + 4);
+    write16(version);
+    write32(entries.size());
+
+    for(auto &entry : entries) {
+      write32(entry.second.size);
+      write16(entry.first.length());
+      buf.insert(buf.end(), entry.first.begin(), entry.first.end());
+      write16(entry.second.title.length());
+      buf.insert(buf.end(), entry.second.title.begin(), entry.second.title.end());
+    }
+
+    File(cache_path(), OpenMode::write).write(0, buf.size(), (const char *)buf.data());
+
+    dirty = false;
+  }
+
+  // track which entries are still there
+  void begin_directory(const std::string &directory) {
+    for(auto &entry : entries) {
+      if(parent_directory(entry.first) == directory)
+        entry.second.seen = false;
+    }
+  }
+
+  // remove anything that wasn't found
+  void end_directory(const std::string &directory) {
+    for(auto it = entries.begin(); it != entries.end();) {
+      if(!it->second.seen && parent_directory(it->first) == directory) {
+        it = entries.erase(it);
+        dirty = true;
+      } else
+        ++it;
+    }
+  }
+
+  bool find(const std::string &filename, uint32_t size, std::string &title) {
+    auto it = entries.find(filename);
+
+    // a different size means the file was replaced
+    if(it == entries.end() || it->second.size != size)
+      return false;
+
+    it->second.seen = true;
+
+    if(!it->second.title.empty())
+      title = it->second.title;
+
+    return true;
+  }
+
+  void store(const std::string &filename, uint32_t size, const std::string &title) {
+    if(!is_cached_path(filename))
+      return;
+
+    entries[filename] = {size, title, true};
+    dirty = true;
+  }
+};
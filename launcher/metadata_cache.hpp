@@ -0,0 +1,22 @@
+/* metadata_cache.hpp
+ * header file for the launcher's metadata cache
+ *
+ * Remembers the titles read from each file's metadata so that the list
+ * doesn't need to open every file each time a directory is shown.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace metadata_cache {
+  void load();
+  void save();
+
+  void begin_directory(const std::string &directory);
+  void end_directory(const std::string &directory);
+
+  bool find(const std::string &filename, uint32_t size, std::string &title);
+  void store(const std::string &filename, uint32_t size, const std::string &title);
+};
@@ -0,0 +1,196 @@
+#include <list>
+#include <map>
+#include <set>
+
+#include "preview_cache.hpp"
+
+#include "32blit.hpp"
+
+using namespace blit;
+
+namespace preview_cache {
+  struct Entry {
+    std::string filename;
+    Preview preview;
+    uint32_t size;
+  };
+
+  struct PendingLoad {
+    std::string filename;
+    LoadFunction load;
+    uint32_t expected_size;
+  };
+
+  // decoded images to keep, only the selected entry can go over this. On the host there's room for a full size
+  // screenshot either side of the selected one, the device only has room to prefetch smaller ones
+#ifdef PICO_BUILD
+  static const uint32_t memory_budget = 48 * 1024;
+#elif defined(TARGET_32BLIT_HW)
+  static const uint32_t memory_budget = 320 * 1024;
+#else
+  static const uint32_t memory_budget = 1024 * 1024;
+#endif
+
+  // most recently used first
+  static std::list<Entry> entries;
+  static std::map<std::string, std::list<Entry>::iterator> index;
+  static uint32_t memory_used = 0;
+
+  static std::string selected_filename;
+  static std::set<std::string> neighbours; // everything prefetched since the last clear_prefetch
+
+  static std::list<PendingLoad> pending;
+
+  static uint32_t surface_size(const Surface *surface) {
+    if(!surface)
+      return 0;
+
+    uint32_t size = surface->bounds.area() * pixel_format_stride[int(surface->format)];
+
+    if(surface->palette)
+      size += 256 * sizeof(Pen);
+
+    return size;
+  }
+
+  void Preview::free_surfaces() {
+    metadata.free_surfaces();
+
+    if(screenshot) {
+      delete[] screenshot->data;
+      delete[] screenshot->palette;
+      delete screenshot;
+      screenshot = nullptr;
+    }
+  }
+
+  uint32_t Preview::memory_size() const {
+    return surface_size(metadata.icon) + surface_size(metadata.splash) + surface_size(screenshot);
+  }
+
+  static void erase(std::list<Entry>::iterator it) {
+    memory_used -= it->size;
+    it->preview.free_surfaces();
+
+    index.erase(it->filename);
+    entries.erase(it);
+  }
+
+  // drop the least recently used entries until there's room for `size` more, a prefetch can't drop the other
+  // neighbours as they were queued nearest first
+  static bool make_room(uint32_t size, bool prefetch) {
+    auto it = entries.end();
+
+    while(memory_used + size > memory_budget && it != entries.begin()) {
+      --it;
+
+      if(it->filename == selected_filename || (prefetch && neighbours.count(it->filename)))
+        continue;
+
+      erase(it++);
+    }
+
+    return memory_used + size <= memory_budget;
+  }
+
+  // prefetched entries go after the selected one, so they're dropped after it but before anything older
+  static void insert_entry(const std::string &filename, Preview &preview, uint32_t size, bool selected) {
+    auto pos = entries.begin();
+    if(!selected && pos != entries.end() && pos->filename == selected_filename)
+      ++pos;
+
+    auto it = entries.insert(pos, {filename, std::move(preview), size});
+    index[filename] = it;
+    memory_used += size;
+  }
+
+  /**
+   * Get the preview for a file, loading it if it isn't cached. The entry stays cached until another is selected.
+   *
+   * \param expected_size Memory the preview is likely to need, to free it before loading
+   */
+  const Preview &get(const std::string &filename, LoadFunction load, uint32_t expected_size) {
+    selected_filename = filename;
+
+    auto it = index.find(filename);
+
+    if(it != index.end()) {
+      // move to the front
+      entries.splice(entries.begin(), entries, it->second);
+      return entries.front().preview;
+    }
+
+    make_room(expected_size, false);
+
+    Preview preview;
+    load(preview);
+
+    // kept even if it doesn't fit
+    auto size = preview.memory_size();
+    make_room(size, false);
+    insert_entry(filename, preview, size, true);
+
+    return entries.front().preview;
+  }
+
+  /**
+   * Queue a file to be loaded by `update`
+   *
+   * \param expected_size Memory the preview is likely to need, it isn't loaded if that much can't be freed
+   */
+  void prefetch(const std::string &filename, LoadFunction load, uint32_t expected_size) {
+    neighbours.insert(filename);
+
+    if(index.find(filename) == index.end())
+      pending.push_back({filename, load, expected_size});
+  }
+
+  void clear_prefetch() {
+    pending.clear();
+    neighbours.clear();
+  }
+
+  /**
+   * Load one queued file
+   */
+  void update() {
+    while(!pending.empty()) {
+      auto load = pending.front();
+      pending.pop_front();
+
+      // may have been selected since it was queued
+      if(index.find(load.filename) != index.end())
+        continue;
+
+      // don't decode something that's going to be dropped
+      if(!make_room(load.expected_size, true))
+        continue;
+
+      Preview preview;
+      load.load(preview);
+
+      auto size = preview.memory_size();
+
+      if(make_room(size, true))
+        insert_entry(load.filename, preview, size, false);
+      else
+        preview.free_surfaces();
+
+      break;
+    }
+  }
+
+  void remove(const std::string &filename) {
+    auto it = index.find(filename);
+
+    if(it != index.end())
+      erase(it->second);
+  }
+
+  void clear() {
+    while(!entries.empty())
+      erase(entries.begin());
+
+    clear_prefetch();
+  }
+};
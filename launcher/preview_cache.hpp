@@ -0,0 +1,34 @@
+/* preview_cache.hpp
+ * header file for the launcher's preview cache
+ *
+ * Keeps the decoded splash/icon images and screenshots of recently
+ * selected files, and decodes the ones next to the selection ahead of
+ * time.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "metadata.hpp"
+
+namespace preview_cache {
+  struct Preview {
+    BlitGameMetadata metadata;
+    blit::Surface *screenshot = nullptr;
+
+    void free_surfaces();
+    uint32_t memory_size() const;
+  };
+
+  using LoadFunction = std::function<void(Preview &preview)>;
+
+  const Preview &get(const std::string &filename, LoadFunction load, uint32_t expected_size = 0);
+  void prefetch(const std::string &filename, LoadFunction load, uint32_t expected_size = 0);
+  void clear_prefetch();
+  void update();
+
+  void remove(const std::string &filename);
+  void clear();
+};
@@ -0,0 +1,423 @@
+// Host-side audio engine benchmark and deterministic renderer
+//
+// audio-bench bench [samples]
+//   Times get_audio_frame() for a set of channel configurations and reports ns/sample.
+//
+// audio-bench render <script> <out.wav>
+//   Runs a script of channel events and writes the output to a .wav file.
+//   The output only depends on the script, so it can be compared against a known good render.
+//
+// audio-bench compare <a.wav> <b.wav>
+//   Reports the largest sample difference between two renders, exits with 1 if they differ.
+//
+// ctest renders test/mixer.txt and compares it with test/reference.wav. If the mixer output changes on purpose,
+// render a new reference.wav from the test directory.
+//
+// Script format, one event per line ('#' starts a comment):
+//   <time_ms> <channel> <command> [args...]
+//
+//   waveforms <mask>         - Waveform bits (NOISE=128, SQUARE=64, SAW=32, TRIANGLE=16, SINE=8)
+//   frequency <hz>
+//   volume <0-65535>
+//   adsr <attack_ms> <decay_ms> <sustain> <release_ms> - times must be at least 1ms
+//   pulse_width <0-65535>
+//   filter <cutoff_hz>       - 0 disables the filter
+//   sample <file.wav> [rate] - play a .wav with the SAMPLE waveform, optionally at a different rate
+//   attack / release / off
+//   end                      - end of the render (channel is ignored)
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio/audio.hpp"
+#include "engine/api_private.hpp"
+
+using namespace blit;
+
+namespace blit {
+  extern uint32_t prng_xorshift_state;
+}
+
+static AudioChannel bench_channels[CHANNEL_COUNT];
+
+// .wav files loaded by scripts, kept until exit as the channels point into them
+static std::vector<std::vector<uint8_t>> loaded_files;
+
+static void reset_audio() {
+  for(auto &channel : bench_channels)
+    channel = AudioChannel();
+
+  api.channels = bench_channels;
+  prng_xorshift_state = 0x32B71700;
+  volume = 0xffff;
+}
+
+static bool write_wav(const std::string &filename, const std::vector<int16_t> &samples) {
+  std::ofstream file(filename, std::ios::binary);
+  if(!file)
+    return false;
+
+  auto write32 = [&file](uint32_t v) {
+    uint8_t b[]{uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+    file.write(reinterpret_cast<char *>(b), 4);
+  };
+
+  auto write16 = [&file](uint16_t v) {
+    uint8_t b[]{uint8_t(v), uint8_t(v >> 8)};
+    file.write(reinterpret_cast<char *>(b), 2);
+  };
+
+  uint32_t data_len = uint32_t(samples.size() * 2);
+
+  file.write("RIFF", 4);
+  write32(36 + data_len);
+  file.write("WAVEfmt ", 8);
+  write32(16);
+  write16(1); // PCM
+  write16(1); // mono
+  write32(sample_rate);
+  write32(sample_rate * 2);
+  write16(2);
+  write16(16);
+  file.write("data", 4);
+  write32(data_len);
+
+  for(auto sample : samples)
+    write16(uint16_t(sample));
+
+  return bool(file);
+}
+
+static bool read_file(const std::string &filename, std::vector<uint8_t> &data) {
+  std::ifstream file(filename, std::ios::binary);
+  if(!file)
+    return false;
+
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+static bool read_wav_samples(const std::string &filename, std::vector<int16_t> &samples) {
+  std::vector<uint8_t> data;
+  Sample sample;
+
+  if(!read_file(filename, data) || !sample.parse_wav(data.data(), uint32_t(data.size())) || sample.format != SampleFormat::PCM16)
+    return false;
+
+  samples.resize(sample.length);
+  for(uint32_t i = 0; i < sample.length; i++)
+    samples[i] = int16_t(sample.data[i * 2] | sample.data[i * 2 + 1] << 8);
+
+  return true;
+}
+
+struct Event {
+  uint32_t time_ms;
+  int channel;
+  std::string command;
+  std::vector<std::string> args;
+  int line;
+};
+
+static bool parse_script(const std::string &filename, std::vector<Event> &events) {
+  std::ifstream file(filename);
+  if(!file) {
+    std::cerr << "Failed to open " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int line_num = 0;
+
+  while(std::getline(file, line)) {
+    line_num++;
+
+    auto comment = line.find('#');
+    if(comment != std::string::npos)
+      line.resize(comment);
+
+    std::istringstream stream(line);
+    Event event;
+    event.line = line_num;
+
+    if(!(stream >> event.time_ms))
+      continue; // blank
+
+    if(!(stream >> event.channel >> event.command) || event.channel < 0 || event.channel >= CHANNEL_COUNT) {
+      std::cerr << filename << ":" << line_num << ": expected <time_ms> <channel> <command>" << std::endl;
+      return false;
+    }
+
+    std::string arg;
+    while(stream >> arg)
+      event.args.push_back(arg);
+
+    events.push_back(event);
+  }
+
+  // events are applied in time order, keeping the script order for equal times
+  std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {return a.time_ms < b.time_ms;});
+
+  return true;
+}
+
+static bool parse_int(const std::string &str, int &value) {
+  char *end;
+  errno = 0;
+  long v = strtol(str.c_str(), &end, 10);
+
+  if(end == str.c_str() || *end || errno == ERANGE || v < INT_MIN || v > INT_MAX)
+    return false;
+
+  value = int(v);
+  return true;
+}
+
+static bool apply_event(const Event &event) {
+  auto &channel = bench_channels[event.channel];
+  auto &cmd = event.command;
+
+  // everything but a sample's filename is a number
+  for(size_t i = cmd == "sample" ? 1 : 0; i < event.args.size(); i++) {
+    int value;
+    if(!parse_int(event.args[i], value)) {
+      std::cerr << "line " << event.line << ": expected a number, got \"" << event.args[i] << "\"" << std::endl;
+      return false;
+    }
+  }
+
+  auto arg = [&event](size_t i) {
+    int value = 0;
+    if(i < event.args.size())
+      parse_int(event.args[i], value);
+    return value;
+  };
+
+  if(cmd == "waveforms")
+    channel.waveforms = arg(0);
+  else if(cmd == "frequency")
+    channel.frequency = arg(0);
+  else if(cmd == "volume")
+    channel.volume = arg(0);
+  else if(cmd == "adsr" && event.args.size() == 4) {
+    // the envelope divides by these
+    if(arg(0) <= 0 || arg(1) <= 0 || arg(3) <= 0) {
+      std::cerr << "line " << event.line << ": adsr times must be at least 1ms" << std::endl;
+      return false;
+    }
+
+    channel.attack_ms = arg(0);
+    channel.decay_ms = arg(1);
+    channel.sustain = arg(2);
+    channel.release_ms = arg(3);
+  } else if(cmd == "pulse_width")
+    channel.pulse_width = arg(0);
+  else if(cmd == "filter") {
+    channel.filter_enable = arg(0) != 0;
+    channel.filter_cutoff_frequency = arg(0);
+  } else if(cmd == "sample" && !event.args.empty()) {
+    loaded_files.emplace_back();
+    auto &data = loaded_files.back();
+
+    Sample sample;
+    if(!read_file(event.args[0], data) || !sample.parse_wav(data.data(), uint32_t(data.size()))) {
+      std::cerr << "line " << event.line << ": failed to load " << event.args[0] << std::endl;
+      return false;
+    }
+
+    channel.play_sample(sample);
+
+    if(event.args.size() > 1)
+      channel.set_sample_rate(arg(1));
+  } else if(cmd == "attack")
+    channel.trigger_attack();
+  else if(cmd == "release")
+    channel.trigger_release();
+  else if(cmd == "off")
+    channel.off();
+  else {
+    std::cerr << "line " << event.line << ": unknown command \"" << cmd << "\"" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+static int render_script(const std::string &script, const std::string &out_filename) {
+  std::vector<Event> events;
+  if(!parse_script(script, events))
+    return 1;
+
+  reset_audio();
+
+  // default to a second after the last event if there's no explicit end
+  uint32_t end_ms = events.empty() ? 0 : events.back().time_ms + 1000;
+  for(auto &event : events) {
+    if(event.command == "end")
+      end_ms = event.time_ms;
+  }
+
+  uint32_t end_sample = uint64_t(end_ms) * sample_rate / 1000;
+
+  std::vector<int16_t> samples;
+  samples.reserve(end_sample);
+
+  auto next_event = events.begin();
+
+  for(uint32_t i = 0; i < end_sample; i++) {
+    // apply any events at or before this sample
+    while(next_event != events.end() && uint64_t(next_event->time_ms) * sample_rate / 1000 <= i) {
+      if(next_event->command != "end" && !apply_event(*next_event))
+        return 1;
+      ++next_event;
+    }
+
+    samples.push_back(int16_t(int(get_audio_frame()) - 0x8000));
+  }
+
+  if(!write_wav(out_filename, samples)) {
+    std::cerr << "Failed to write " << out_filename << std::endl;
+    return 1;
+  }
+
+  std::cout << "Rendered " << samples.size() << " samples to " << out_filename << std::endl;
+  return 0;
+}
+
+static int compare_wavs(const std::string &a_filename, const std::string &b_filename) {
+  std::vector<int16_t> a, b;
+
+  if(!read_wav_samples(a_filename, a) || !read_wav_samples(b_filename, b)) {
+    std::cerr << "Failed to read inputs (expected 16-bit mono .wav)" << std::endl;
+    return 2;
+  }
+
+  if(a.size() != b.size()) {
+    std::cout << "Length differs: " << a.size() << " vs " << b.size() << std::endl;
+    return 1;
+  }
+
+  int max_diff = 0;
+  size_t num_diff = 0, first_diff = 0;
+
+  for(size_t i = 0; i < a.size(); i++) {
+    int diff = std::abs(a[i] - b[i]);
+    if(diff) {
+      if(!num_diff)
+        first_diff = i;
+      num_diff++;
+    }
+    max_diff = std::max(max_diff, diff);
+  }
+
+  if(!num_diff) {
+    std::cout << "Identical (" << a.size() << " samples)" << std::endl;
+    return 0;
+  }
+
+  std::cout << num_diff << " samples differ, first at " << first_diff << ", max difference " << max_diff << std::endl;
+  return 1;
+}
+
+struct BenchConfig {
+  const char *name;
+  int num_channels;
+  uint8_t waveforms;
+  bool filter;
+};
+
+static int bench(uint32_t num_samples) {
+  static const BenchConfig configs[] {
+    {"idle",                 0, 0,                                   false},
+    {"1x sine",              1, Waveform::SINE,                      false},
+    {"1x square",            1, Waveform::SQUARE,                    false},
+    {"1x noise",             1, Waveform::NOISE,                     false},
+    {"1x sine+square+saw",   1, Waveform::SINE | Waveform::SQUARE | Waveform::SAW, false},
+    {"1x sine filtered",     1, Waveform::SINE,                      true},
+    {"1x sample (16-bit)",   1, Waveform::SAMPLE,                    false},
+    {"4x triangle",          4, Waveform::TRIANGLE,                  false},
+    {"8x sine",              8, Waveform::SINE,                      false},
+    {"8x all waveforms",     8, Waveform::NOISE | Waveform::SQUARE | Waveform::SAW | Waveform::TRIANGLE | Waveform::SINE, false},
+    {"8x sample (16-bit)",   8, Waveform::SAMPLE,                    false},
+  };
+
+  // a looping buffer for the sample voices
+  static int16_t sample_data[4096];
+  for(int i = 0; i < 4096; i++)
+    sample_data[i] = int16_t((i * 97) & 0xFFFF);
+
+  Sample sample(reinterpret_cast<uint8_t *>(sample_data), 4096, SampleFormat::PCM16);
+  sample.loop_end = 4096;
+
+  printf("%-24s %12s\n", "config", "ns/sample");
+
+  for(auto &config : configs) {
+    reset_audio();
+
+    for(int c = 0; c < config.num_channels; c++) {
+      auto &channel = bench_channels[c];
+      channel.frequency = 220 + c * 110;
+      channel.filter_enable = config.filter;
+      channel.filter_cutoff_frequency = 2000;
+
+      if(config.waveforms == Waveform::SAMPLE)
+        channel.play_sample(sample);
+      else {
+        channel.waveforms = config.waveforms;
+        channel.trigger_attack();
+      }
+    }
+
+    uint32_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < num_samples; i++)
+      checksum += get_audio_frame();
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / num_samples;
+
+    // print the checksum so the loop can't be optimised out
+    printf("%-24s %12.2f  (%08x)\n", config.name, ns, checksum);
+  }
+
+  return 0;
+}
+
+static void usage(const char *name) {
+  std::cerr << "Usage:" << std::endl;
+  std::cerr << "  " << name << " bench [samples]" << std::endl;
+  std::cerr << "  " << name << " render <script> <out.wav>" << std::endl;
+  std::cerr << "  " << name << " compare <a.wav> <b.wav>" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if(argc < 2) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::string mode(argv[1]);
+
+  if(mode == "bench")
+    return bench(argc > 2 ? std::stoul(argv[2]) : sample_rate * 60);
+
+  if(mode == "render" && argc == 4)
+    return render_script(argv[2], argv[3]);
+
+  if(mode == "compare" && argc == 4)
+    return compare_wavs(argv[2], argv[3]);
+
+  usage(argv[0]);
+  return 2;
+}
@@ -0,0 +1,69 @@
+#
+# pack-font.py
+# 32blit
+#
+# convert a TrueType font to the anti-aliased packed font format ("FNT2") used by blit::Font
+# the output can be included in a game with the raw binary asset type
+#
+# usage: pack-font.py font.ttf output.bin --height 10 --bpp 4 [--chars 32-126,160-255]
+#
+import argparse
+import struct
+
+from PIL import Image, ImageDraw, ImageFont
+
+
+def parse_ranges(ranges):
+    code_points = set()
+    for part in ranges.split(','):
+        if '-' in part:
+            start, end = part.split('-')
+            code_points.update(range(int(start, 0), int(end, 0) + 1))
+        else:
+            code_points.add(int(part, 0))
+    return sorted(code_points)
+
+
+parser = argparse.ArgumentParser(description='Pack a TrueType font for 32blit')
+parser.add_argument('input', help='TrueType font')
+parser.add_argument('output', help='Output file')
+parser.add_argument('--height', type=int, default=8, help='Font height in pixels')
+parser.add_argument('--bpp', type=int, default=4, choices=[1, 2, 4], help='Bits per pixel')
+parser.add_argument('--chars', default='32-126', help='Code points to include (e.g. 32-126,160-255)')
+parser.add_argument('--spacing', type=int, default=1, help='Extra line spacing')
+args = parser.parse_args()
+
+font = ImageFont.truetype(args.input, args.height)
+ascent, descent = font.getmetrics()
+code_points = [c for c in parse_ranges(args.chars) if c == 32 or font.getmask(chr(c)).getbbox()]
+
+char_h = ascent + descent
+widths = [max(1, round(font.getlength(chr(c)))) for c in code_points]
+char_w = max(widths)
+
+max_coverage = (1 << args.bpp) - 1
+row_bytes = (char_w * args.bpp + 7) // 8
+
+glyph_data = bytearray()
+for c in code_points:
+    image = Image.new('L', (char_w, char_h))
+    ImageDraw.Draw(image).text((0, 0), chr(c), font=font, fill=255)
+
+    for y in range(char_h):
+        row = bytearray(row_bytes)
+        for x in range(char_w):
+            coverage = (image.getpixel((x, y)) * max_coverage + 127) // 255
+            bit = x * args.bpp
+            row[bit // 8] |= coverage << (bit % 8)
+        glyph_data += row
+
+data = b'FNT2'
+data += struct.pack('<HBBBBH', len(code_points), char_w, char_h, args.spacing, args.bpp, 0)
+data += b''.join(struct.pack('<I', c) for c in code_points)
+data += bytes(min(w, 255) for w in widths)
+data += glyph_data
+
+with open(args.output, 'wb') as f:
+    f.write(data)
+
+print(f'Packed {len(code_points)} characters ({char_w}x{char_h}, {args.bpp}bpp) to {args.output}, {len(data)} bytes')